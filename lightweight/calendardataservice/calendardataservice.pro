@@ -2,7 +2,7 @@ TEMPLATE = app
 TARGET = calendardataservice
 target.path = /usr/bin
 
-QT += qml dbus
+QT += qml dbus concurrent
 QT -= gui
 
 CONFIG += link_pkgconfig timed-qt5
@@ -14,9 +14,12 @@ HEADERS += \
     ../common/eventdata.h \
     ../../src/calendaragendamodel.h \
     ../../src/calendareventlistmodel.h \
+    ../../src/calendarmonthsummarymodel.h \
     ../../src/calendarsearchmodel.h \
     ../../src/calendarmanager.h \
+    ../../src/calendaroccurrenceindex.h \
     ../../src/calendarworker.h \
+    ../../src/calendarsender.h \
     ../../src/calendareventoccurrence.h \
     ../../src/calendarevent.h \
     ../../src/calendareventquery.h \
@@ -29,9 +32,12 @@ SOURCES += \
     ../common/eventdata.cpp \
     ../../src/calendaragendamodel.cpp \
     ../../src/calendareventlistmodel.cpp \
+    ../../src/calendarmonthsummarymodel.cpp \
     ../../src/calendarsearchmodel.cpp \
     ../../src/calendarmanager.cpp \
+    ../../src/calendaroccurrenceindex.cpp \
     ../../src/calendarworker.cpp \
+    ../../src/calendarsender.cpp \
     ../../src/calendareventoccurrence.cpp \
     ../../src/calendarevent.cpp \
     ../../src/calendareventquery.cpp \
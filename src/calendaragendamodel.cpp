@@ -38,14 +38,18 @@
 #include "calendarmanager.h"
 
 #include <QDebug>
+#include <QQmlEngine>
 
 CalendarAgendaModel::CalendarAgendaModel(QObject *parent)
     : QAbstractListModel(parent), m_isComplete(true), m_filterMode(FilterNone)
 {
     connect(CalendarManager::instance(), SIGNAL(storageModified()), this, SLOT(refresh()));
-    connect(CalendarManager::instance(), SIGNAL(dataUpdated()), this, SLOT(refresh()));
+    connect(CalendarManager::instance(), &CalendarManager::dataChanged,
+            this, &CalendarAgendaModel::onDataChanged);
     connect(CalendarManager::instance(), &CalendarManager::timezoneChanged,
             this, &CalendarAgendaModel::onTimezoneChanged);
+    connect(CalendarManager::instance(), &CalendarManager::instanceIdChanged,
+            this, &CalendarAgendaModel::onInstanceIdChanged);
 }
 
 CalendarAgendaModel::~CalendarAgendaModel()
@@ -54,8 +58,6 @@ CalendarAgendaModel::~CalendarAgendaModel()
     if (manager) {
         manager->cancelAgendaRefresh(this);
     }
-    qDeleteAll(m_events);
-    m_events.clear();
 }
 
 QHash<int, QByteArray> CalendarAgendaModel::roleNames() const
@@ -107,72 +109,80 @@ void CalendarAgendaModel::refresh()
     CalendarManager::instance()->scheduleAgendaRefresh(this);
 }
 
-static bool eventsEqual(const CalendarEventOccurrence *e1,
-                        const CalendarEventOccurrence *e2)
+void CalendarAgendaModel::onDataChanged(const QList<CalendarData::Range> &ranges,
+                                       const QStringList &instanceIds, bool reset)
 {
-    if (e1->startTime() != e2->startTime() || e1->endTime() != e2->endTime()) {
-        return false;
-    }
+    Q_UNUSED(instanceIds);
+
+    if (!m_isComplete || !m_startDate.isValid())
+        return;
 
-    CalendarEvent *eventObject1 = e1->eventObject();
-    CalendarEvent *eventObject2 = e2->eventObject();
+    bool changed = reset;
+    const QDate endDate = m_endDate.isValid() ? m_endDate : m_startDate;
+    // Loaded ranges come with the occurrences overlapping them,
+    // extended by one day on both sides.
+    for (int i = 0; i < ranges.count() && !changed; ++i)
+        changed = ranges[i].first.addDays(-1) <= endDate && ranges[i].second.addDays(1) >= m_startDate;
 
-    return eventObject1 && eventObject2 &&
-           eventObject1->instanceId() == eventObject2->instanceId();
+    CalendarManager::instance()->countDataRefresh(!changed);
+    if (changed)
+        refresh();
 }
 
-static bool eventsLessThan(const CalendarEventOccurrence *e1,
-                           const CalendarEventOccurrence *e2)
+CalendarAgendaModel::AgendaRow CalendarAgendaModel::createRow(const CalendarData::EventOccurrence &occurrence,
+                                                              const CalendarData::EventPtr &event)
 {
-    if (e1->startTime() == e2->startTime()) {
-        int cmp = QString::compare(e1->eventObject()->displayLabel(),
-                                   e2->eventObject()->displayLabel(),
-                                   Qt::CaseInsensitive);
-        if (cmp == 0)
-            return QString::compare(e1->eventObject()->instanceId(), e2->eventObject()->instanceId()) < 0;
-        else
-            return cmp < 0;
-    } else {
-        return e1->startTime() < e2->startTime();
+    AgendaRow row;
+    row.occurrence = occurrence;
+    row.event = event;
+    row.startMSecs = occurrence.startTime.toMSecsSinceEpoch();
+    row.endMSecs = occurrence.endTime.toMSecsSinceEpoch();
+    if (event) {
+        // Records from the worker come with the key already folded.
+        row.labelKey = event->contentHash ? event->labelKey
+            : event->displayLabel.toCaseFolded().toUtf8();
     }
+    row.object = nullptr;
+    return row;
 }
 
-void CalendarAgendaModel::doRefresh(QList<CalendarEventOccurrence *> newEvents)
+bool CalendarAgendaModel::rowsEqual(const AgendaRow &r1, const AgendaRow &r2)
 {
-    QList<CalendarEventOccurrence *> events = m_events;
-    QList<CalendarEventOccurrence *> skippedEvents;
-
-    QSet<QString> alreadyAddedCalendarUids;
-    // filter out if necessary
-    if (m_filterMode != FilterNone) {
-        QList<CalendarEventOccurrence *>::iterator it = newEvents.begin();
-        while (it != newEvents.end()) {
-            bool skip = false;
-            if (m_filterMode & FilterNonAllDay && !(*it)->eventObject()->allDay()) {
-                skip = true;
-            }
-            if (m_filterMode & FilterAllDay && (*it)->eventObject()->allDay()) {
-                skip = true;
-            }
-            if (m_filterMode & FilterMultipleEventsPerNotebook) {
-                QString uid = (*it)->eventObject()->calendarUid();
-                if (alreadyAddedCalendarUids.contains(uid)) {
-                    skip = true;
-                } else {
-                    alreadyAddedCalendarUids.insert(uid);
-                }
-            }
+    return r1.startMSecs == r2.startMSecs
+        && r1.endMSecs == r2.endMSecs
+        && r1.occurrence.instanceId == r2.occurrence.instanceId;
+}
 
-            if (skip) {
-                skippedEvents.append(*it);
-                it = newEvents.erase(it);
-            } else {
-                it++;
-            }
-        }
-    }
+bool CalendarAgendaModel::rowsLessThan(const AgendaRow &r1, const AgendaRow &r2)
+{
+    if (r1.startMSecs != r2.startMSecs)
+        return r1.startMSecs < r2.startMSecs;
+    if (r1.labelKey != r2.labelKey)
+        return r1.labelKey < r2.labelKey;
+    return QString::compare(r1.occurrence.instanceId, r2.occurrence.instanceId) < 0;
+}
 
-    std::sort(newEvents.begin(), newEvents.end(), eventsLessThan);
+void CalendarAgendaModel::releaseObject(const AgendaRow &row)
+{
+    // The model owns the occurrence objects, they live as long as their
+    // row. Deleted later as delegates of the removed rows may still
+    // read them until the rows removal is over. QML references kept
+    // elsewhere become null then.
+    if (row.object)
+        row.object->deleteLater();
+}
+
+void CalendarAgendaModel::doRefresh(const QVector<CalendarData::EventOccurrence> &occurrences)
+{
+    CalendarManager *manager = CalendarManager::instance();
+    const QVector<AgendaRow> events = m_events;
+    QVector<AgendaRow> newEvents;
+    newEvents.reserve(occurrences.count());
+
+    for (const CalendarData::EventOccurrence &occurrence : occurrences)
+        newEvents.append(createRow(occurrence, manager->getEventRecord(occurrence.instanceId)));
+
+    std::sort(newEvents.begin(), newEvents.end(), rowsLessThan);
 
     int oldEventCount = m_events.count();
     int newEventsCounter = 0;
@@ -184,8 +194,8 @@ void CalendarAgendaModel::doRefresh(QList<CalendarEventOccurrence *> newEvents)
         int removeCount = 0;
         while ((eventsCounter + removeCount) < events.count()
                 && (newEventsCounter >= newEvents.count()
-                    || eventsLessThan(events.at(eventsCounter + removeCount),
-                                      newEvents.at(newEventsCounter)))) {
+                    || rowsLessThan(events.at(eventsCounter + removeCount),
+                                    newEvents.at(newEventsCounter)))) {
             removeCount++;
         }
 
@@ -194,14 +204,18 @@ void CalendarAgendaModel::doRefresh(QList<CalendarEventOccurrence *> newEvents)
             m_events.erase(m_events.begin() + m_eventsIndex, m_events.begin() + m_eventsIndex + removeCount);
             endRemoveRows();
             for (int ii = eventsCounter; ii < eventsCounter + removeCount; ++ii)
-                delete events.at(ii);
+                releaseObject(events.at(ii));
             eventsCounter += removeCount;
         }
 
-        // Skip matching events
+        // Skip matching events, keeping their rows and objects
         while (eventsCounter < events.count() && newEventsCounter < newEvents.count() &&
-               eventsEqual(newEvents.at(newEventsCounter), events.at(eventsCounter))) {
-            skippedEvents.append(newEvents.at(newEventsCounter));
+               rowsEqual(newEvents.at(newEventsCounter), events.at(eventsCounter))) {
+            const CalendarData::EventPtr &event = newEvents.at(newEventsCounter).event;
+            if (m_events.at(m_eventsIndex).event != event) {
+                m_events[m_eventsIndex].event = event;
+                m_events[m_eventsIndex].labelKey = newEvents.at(newEventsCounter).labelKey;
+            }
             eventsCounter++;
             newEventsCounter++;
             m_eventsIndex++;
@@ -211,15 +225,14 @@ void CalendarAgendaModel::doRefresh(QList<CalendarEventOccurrence *> newEvents)
         int insertCount = 0;
         while ((newEventsCounter + insertCount) < newEvents.count()
                && (eventsCounter >= events.count()
-                   || !(eventsLessThan(events.at(eventsCounter),
-                                       newEvents.at(newEventsCounter + insertCount))))) {
+                   || !(rowsLessThan(events.at(eventsCounter),
+                                     newEvents.at(newEventsCounter + insertCount))))) {
             insertCount++;
         }
 
         if (insertCount) {
             beginInsertRows(QModelIndex(), m_eventsIndex, m_eventsIndex + insertCount - 1);
             for (int ii = 0; ii < insertCount; ++ii) {
-                newEvents.at(newEventsCounter + ii)->setParent(this);
                 m_events.insert(m_eventsIndex++, newEvents.at(newEventsCounter + ii));
             }
             newEventsCounter += insertCount;
@@ -227,8 +240,6 @@ void CalendarAgendaModel::doRefresh(QList<CalendarEventOccurrence *> newEvents)
         }
     }
 
-    qDeleteAll(skippedEvents);
-
     if (oldEventCount != m_events.count())
         emit countChanged();
 
@@ -277,13 +288,20 @@ QVariant CalendarAgendaModel::get(int index, int role) const
         return QVariant();
     }
 
+    const AgendaRow &row = m_events.at(index);
     switch (role) {
     case EventObjectRole:
-        return QVariant::fromValue<QObject *>(m_events.at(index)->eventObject());
+        return QVariant::fromValue<QObject *>(CalendarManager::instance()->eventObject(row.occurrence.instanceId));
     case OccurrenceObjectRole:
-        return QVariant::fromValue<QObject *>(m_events.at(index));
+        if (!row.object) {
+            row.object = new CalendarEventOccurrence(row.occurrence,
+                                                     const_cast<CalendarAgendaModel *>(this));
+            // Returned from an invokable, QML would take it otherwise.
+            QQmlEngine::setObjectOwnership(row.object, QQmlEngine::CppOwnership);
+        }
+        return QVariant::fromValue<QObject *>(row.object);
     case SectionBucketRole:
-        return m_events.at(index)->startTime().date();
+        return row.occurrence.startTime.date();
     default:
         qWarning() << "CalendarAgendaModel: Unknown role asked";
         return QVariant();
@@ -292,13 +310,25 @@ QVariant CalendarAgendaModel::get(int index, int role) const
 
 void CalendarAgendaModel::onTimezoneChanged()
 {
-    QList<CalendarEventOccurrence *>::ConstIterator it;
-    for (it = m_events.constBegin(); it != m_events.constEnd(); it++) {
+    for (const AgendaRow &row : m_events) {
+        if (!row.object)
+            continue;
         // Actually, the date times have not changed, but
         // their representations in local time (as used in QML)
         // have changed.
-        (*it)->startTimeChanged();
-        (*it)->endTimeChanged();
+        row.object->startTimeChanged();
+        row.object->endTimeChanged();
+    }
+}
+
+void CalendarAgendaModel::onInstanceIdChanged(const QString &oldId, const QString &newId,
+                                              const QString &notebookUid)
+{
+    Q_UNUSED(notebookUid);
+
+    for (int i = 0; i < m_events.count(); ++i) {
+        if (m_events.at(i).occurrence.instanceId == oldId)
+            m_events[i].occurrence.instanceId = newId;
     }
 }
 
@@ -34,9 +34,12 @@
 #define CALENDARAGENDAMODEL_H
 
 #include <QDate>
+#include <QVector>
 #include <QAbstractListModel>
 #include <QQmlParserStatus>
 
+#include "calendardata.h"
+
 class CalendarEvent;
 class CalendarEventOccurrence;
 
@@ -81,8 +84,8 @@ public:
     int filterMode() const;
     void setFilterMode(int mode);
 
-    // CalendarAgendaModel takes ownership of the CalendarEventOccurrence objects
-    void doRefresh(QList<CalendarEventOccurrence *>);
+    // The occurrences are already filtered according to filterMode.
+    void doRefresh(const QVector<CalendarData::EventOccurrence> &occurrences);
 
     int rowCount(const QModelIndex &index) const;
     QVariant data(const QModelIndex &index, int role) const;
@@ -104,11 +107,31 @@ protected:
 private slots:
     void refresh();
     void onTimezoneChanged();
+    void onDataChanged(const QList<CalendarData::Range> &ranges, const QStringList &instanceIds, bool reset);
+    void onInstanceIdChanged(const QString &oldId, const QString &newId, const QString &notebookUid);
 
 private:
+    // Rows are plain values, the occurrence object is only created
+    // once asked through the occurrence role. The sort key is computed
+    // when the row is built: start time, folded label and instance id.
+    struct AgendaRow {
+        CalendarData::EventOccurrence occurrence;
+        CalendarData::EventPtr event;
+        qint64 startMSecs;
+        qint64 endMSecs;
+        QByteArray labelKey;
+        mutable CalendarEventOccurrence *object;
+    };
+
+    static AgendaRow createRow(const CalendarData::EventOccurrence &occurrence,
+                               const CalendarData::EventPtr &event);
+    static bool rowsEqual(const AgendaRow &r1, const AgendaRow &r2);
+    static bool rowsLessThan(const AgendaRow &r1, const AgendaRow &r2);
+    void releaseObject(const AgendaRow &row);
+
     QDate m_startDate;
     QDate m_endDate;
-    QList<CalendarEventOccurrence *> m_events;
+    QVector<AgendaRow> m_events;
 
     bool m_isComplete;
     int m_filterMode;
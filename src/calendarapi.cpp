@@ -38,13 +38,25 @@
 #include "calendareventoccurrence.h"
 #include "calendarmanager.h"
 
+static int nextBatchId = 0;
+
 CalendarApi::CalendarApi(QObject *parent)
-: QObject(parent)
+: QObject(parent), m_batchDepth(0), m_batchId(++nextBatchId)
 {
     connect(CalendarManager::instance(), SIGNAL(excludedNotebooksChanged(QStringList)),
             this, SIGNAL(excludedNotebooksChanged()));
     connect(CalendarManager::instance(), SIGNAL(defaultNotebookChanged(QString)),
             this, SIGNAL(defaultNotebookChanged()));
+    connect(CalendarManager::instance(), &CalendarManager::batchCommitted,
+            this, &CalendarApi::onBatchCommitted);
+}
+
+CalendarApi::~CalendarApi()
+{
+    // Do not leave the storage waiting for a commit that will never come.
+    CalendarManager *manager = CalendarManager::instance(false);
+    if (manager && m_batchDepth > 0)
+        manager->abortBatch(m_batchId);
 }
 
 CalendarEventModification *CalendarApi::createNewEvent()
@@ -72,6 +84,28 @@ void CalendarApi::removeAll(const QString &instanceId)
     CalendarManager::instance()->save();
 }
 
+void CalendarApi::beginBatch()
+{
+    ++m_batchDepth;
+    CalendarManager::instance()->beginBatch(m_batchId);
+}
+
+void CalendarApi::commitBatch()
+{
+    if (m_batchDepth == 0) {
+        qWarning("CalendarApi::commitBatch() called without beginBatch()");
+        return;
+    }
+    --m_batchDepth;
+    CalendarManager::instance()->commitBatch(m_batchId);
+}
+
+void CalendarApi::onBatchCommitted(int batchId, bool saved)
+{
+    if (batchId == m_batchId)
+        emit batchCommitted(saved);
+}
+
 QStringList CalendarApi::excludedNotebooks() const
 {
     return CalendarManager::instance()->excludedNotebooks();
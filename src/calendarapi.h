@@ -51,6 +51,7 @@ class CalendarApi : public QObject
 
 public:
     CalendarApi(QObject *parent = 0);
+    ~CalendarApi();
 
     Q_INVOKABLE CalendarEventModification *createNewEvent();
     Q_INVOKABLE CalendarEventModification *createModification(CalendarStoredEvent *sourceEvent,
@@ -60,6 +61,11 @@ public:
                             const QDateTime &time = QDateTime());
     Q_INVOKABLE void removeAll(const QString &instanceId); // remove all instances of an event, including exceptions
 
+    // Changes done in between are saved in one storage transaction,
+    // batchCommitted() is emitted once saved. Batches can be nested.
+    Q_INVOKABLE void beginBatch();
+    Q_INVOKABLE void commitBatch();
+
     QStringList excludedNotebooks() const;
     void setExcludedNotebooks(const QStringList &);
 
@@ -71,6 +77,14 @@ public:
 signals:
     void excludedNotebooksChanged();
     void defaultNotebookChanged();
+    void batchCommitted(bool saved);
+
+private slots:
+    void onBatchCommitted(int batchId, bool saved);
+
+private:
+    int m_batchDepth;
+    int m_batchId; // identifies the batches of this instance
 };
 
 #endif // CALENDARAPI_H
@@ -36,6 +36,10 @@
 #include <QString>
 #include <QUrl>
 #include <QDateTime>
+#include <QHash>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QVector>
 
 // KCalendarCore
 #include <KCalendarCore/Event>
@@ -44,19 +48,94 @@
 
 namespace CalendarData {
 
+// Compact occurrence identifier: the instance identifier of the event,
+// interned in a table shared by all threads, and the start time. Keys of
+// an instance share its entry, they are compared and hashed without
+// looking at the string. The entry is released with the last key.
+struct OccurrenceKey {
+    OccurrenceKey() {}
+    OccurrenceKey(const QString &instanceId, const QDateTime &startTime);
+    // Same instance as other, at another start time.
+    OccurrenceKey(const OccurrenceKey &other, qint64 start);
+    OccurrenceKey(const OccurrenceKey &other);
+    ~OccurrenceKey();
+
+    OccurrenceKey &operator=(const OccurrenceKey &other);
+
+    QString instanceId() const;
+    QString toString() const;
+    // Instance identifiers currently interned.
+    static int internedCount();
+
+    bool operator==(const OccurrenceKey &other) const
+    {
+        return event == other.event && start == other.start;
+    }
+
+    bool operator!=(const OccurrenceKey &other) const
+    {
+        return !operator==(other);
+    }
+
+    struct Instance;
+    Instance *event = nullptr;
+    qint64 start = 0;
+};
+
+inline uint qHash(const OccurrenceKey &key, uint seed = 0)
+{
+    // Mixed rather than XORed, the parts would cancel each other out.
+    uint hash = ::qHash(key.start, seed);
+    hash ^= ::qHash(quintptr(key.event), seed) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
 struct EventOccurrence {
     QString instanceId;
     QDateTime startTime;
     QDateTime endTime;
     bool eventAllDay;
 
-    QString getId() const
+    OccurrenceKey key() const
+    {
+        return OccurrenceKey(instanceId, startTime);
+    }
+
+    // First and last days covered by the occurrence, in local time.
+    // On all day events the end time is inclusive, otherwise not.
+    QDate startDate() const
+    {
+        return eventAllDay ? startTime.date() : startTime.toLocalTime().date();
+    }
+
+    QDate endDate() const
     {
-        return QString("%1-%2").arg(instanceId).arg(startTime.toMSecsSinceEpoch());
+        return eventAllDay ? endTime.date() : endTime.toLocalTime().addSecs(-1).date();
     }
 };
 
 struct Event {
+    // Properties notified by CalendarEvent on changes.
+    enum Property {
+        AllDayProperty = 0x1,
+        DisplayLabelProperty = 0x2,
+        DescriptionProperty = 0x4,
+        EndTimeProperty = 0x8,
+        LocationProperty = 0x10,
+        SecrecyProperty = 0x20,
+        StatusProperty = 0x40,
+        RecurProperty = 0x80,
+        ReminderProperty = 0x100,
+        ReminderDateTimeProperty = 0x200,
+        StartTimeProperty = 0x400,
+        RsvpProperty = 0x800,
+        ExternalInvitationProperty = 0x1000,
+        OwnerStatusProperty = 0x2000,
+        SyncFailureProperty = 0x4000
+    };
+    Q_DECLARE_FLAGS(Properties, Property)
+    static const int PropertyCount = 15;
+
     QString displayLabel;
     QString description;
     QDateTime startTime;
@@ -80,6 +159,16 @@ struct Event {
     CalendarEvent::Status status = CalendarEvent::StatusNone;
     CalendarEvent::SyncFailure syncFailure = CalendarEvent::NoSyncFailure;
     CalendarEvent::SyncFailureResolution syncFailureResolution = CalendarEvent::RetrySync;
+    // False when description and location were left out, as done on range
+    // loads. They are then fetched on first use.
+    bool detailsLoaded = true;
+    // Hashes of the notified properties and their combination, zero when not
+    // computed. Set by updateHashes() once the record is complete.
+    uint contentHash = 0;
+    uint propertyHashes[PropertyCount] = {};
+    // Case folded display label in UTF-8, orders events starting at the
+    // same time with plain byte comparisons. Set along with the hashes.
+    QByteArray labelKey;
 
     Event() {}
     Event(const KCalendarCore::Event &event);
@@ -96,7 +185,12 @@ struct Event {
         return !instanceId.isEmpty();
     }
 
+    void updateHashes();
+    void setDetails(const Event &other);
+    Properties changedProperties(const Event &other) const;
+
 private:
+    void combineHashes();
     int fromKReminder(const KCalendarCore::Event &event) const;
     QDateTime fromKReminderDateTime(const KCalendarCore::Event &event) const;
     void toKReminder(KCalendarCore::Event &event) const;
@@ -105,6 +199,10 @@ private:
     void toKRecurrence(KCalendarCore::Event &event) const;
 };
 
+// Event records are not modified once created, the manager cache and
+// the event objects share them. Updates replace the record as a whole.
+typedef QSharedPointer<const Event> EventPtr;
+
 struct Notebook {
     QString name;
     QString uid;
@@ -137,6 +235,20 @@ struct Notebook {
 
 typedef QPair<QDate,QDate> Range;
 
+// What the worker loaded for the manager, handed over as a whole.
+// The containers are implicitly shared, so the manager adopts them
+// without copying their elements while its own caches are empty.
+struct LoadResult {
+    QList<Range> ranges;
+    QStringList instanceList;
+    QHash<QString, EventPtr> events;
+    QHash<OccurrenceKey, EventOccurrence> occurrences;
+    QHash<QDate, QVector<OccurrenceKey> > dailyOccurrences;
+    bool reset = false;
+};
+
+typedef QSharedPointer<const LoadResult> LoadResultPtr;
+
 struct Attendee {
     bool isOrganizer = false;
     QString name;
@@ -153,6 +265,34 @@ struct Attendee {
     }
 };
 
+// Invitations and updates sent by the worker, see CalendarSender.
+struct OutboundStatistics {
+    int backlog = 0; // messages waiting to be sent
+    int sent = 0;
+    int retried = 0;
+    int failed = 0; // given up after the retries
+    qint64 lastLatency = -1; // ms from queuing to sending
+    qint64 maxLatency = -1;
+};
+
+// Occurrences of a day as shown in a month grid, see CalendarMonthSummaryModel.
+struct DaySummary {
+    int eventCount = 0;
+    bool hasAllDay = false;
+    QStringList notebookUids; // sorted, without duplicates
+
+    bool operator==(const DaySummary &other) const
+    {
+        return eventCount == other.eventCount && hasAllDay == other.hasAllDay
+            && notebookUids == other.notebookUids;
+    }
+
+    bool operator!=(const DaySummary &other) const
+    {
+        return !operator==(other);
+    }
+};
+
 struct EmailContact {
     EmailContact(const QString &aName, const QString &aEmail)
         : name(aName), email(aEmail) {}
@@ -161,4 +301,7 @@ struct EmailContact {
 };
 
 }
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(CalendarData::Event::Properties)
+
 #endif // NEMOCALENDARDATA_H
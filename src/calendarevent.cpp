@@ -44,25 +44,28 @@
 #include "calendardata.h"
 
 CalendarEvent::CalendarEvent(const CalendarData::Event *data, QObject *parent)
-    : QObject(parent), m_data(new CalendarData::Event)
+    : QObject(parent), m_data(data ? new CalendarData::Event(*data) : new CalendarData::Event)
+{
+}
+
+CalendarEvent::CalendarEvent(const CalendarData::EventPtr &data, QObject *parent)
+    : QObject(parent), m_data(data ? data : CalendarData::EventPtr(new CalendarData::Event))
 {
-    if (data)
-        *m_data = *data;
 }
 
 CalendarEvent::CalendarEvent(const CalendarEvent *other, QObject *parent)
-    : QObject(parent), m_data(new CalendarData::Event)
+    : QObject(parent)
 {
     if (other) {
-        *m_data = *other->m_data;
+        m_data = other->m_data;
     } else {
         qWarning("Null source passed to CalendarEvent().");
+        m_data = CalendarData::EventPtr(new CalendarData::Event);
     }
 }
 
 CalendarEvent::~CalendarEvent()
 {
-    delete m_data;
 }
 
 QString CalendarEvent::displayLabel() const
@@ -72,6 +75,8 @@ QString CalendarEvent::displayLabel() const
 
 QString CalendarEvent::description() const
 {
+    if (!m_data->detailsLoaded)
+        fetchDetails();
     return m_data->description;
 }
 
@@ -181,6 +186,8 @@ QString CalendarEvent::calendarUid() const
 
 QString CalendarEvent::location() const
 {
+    if (!m_data->detailsLoaded)
+        fetchDetails();
     return m_data->location;
 }
 
@@ -219,7 +226,11 @@ bool CalendarEvent::externalInvitation() const
     return m_data->externalInvitation;
 }
 
-CalendarStoredEvent::CalendarStoredEvent(CalendarManager *manager, const CalendarData::Event *data)
+void CalendarEvent::fetchDetails() const
+{
+}
+
+CalendarStoredEvent::CalendarStoredEvent(CalendarManager *manager, const CalendarData::EventPtr &data)
     : CalendarEvent(data, manager)
     , m_manager(manager)
 {
@@ -242,10 +253,12 @@ void CalendarStoredEvent::notebookColorChanged(QString notebookUid)
 void CalendarStoredEvent::instanceIdNotified(QString oldId, QString newId, QString notebookUid)
 {
     if (m_data->instanceId == oldId) {
-        m_data->instanceId = newId;
-        emit instanceIdChanged();
+        CalendarData::Event *data = new CalendarData::Event(*m_data);
+        data->instanceId = newId;
         // Event uid changes when the event is moved between notebooks, calendar uid has changed
-        m_data->calendarUid = notebookUid;
+        data->calendarUid = notebookUid;
+        m_data = CalendarData::EventPtr(data);
+        emit instanceIdChanged();
         emit calendarUidChanged();
         emit colorChanged();
     }
@@ -253,12 +266,10 @@ void CalendarStoredEvent::instanceIdNotified(QString oldId, QString newId, QStri
 
 bool CalendarStoredEvent::sendResponse(int response)
 {
-    if (m_manager->sendResponse(m_data->instanceId, (Response)response)) {
-        m_manager->save();
-        return true;
-    } else {
+    if (m_data->instanceId.isEmpty())
         return false;
-    }
+    m_manager->sendResponse(m_data->instanceId, (Response)response);
+    return true;
 }
 
 void CalendarStoredEvent::deleteEvent()
@@ -291,48 +302,68 @@ CalendarStoredEvent* CalendarStoredEvent::parent() const
     }
 }
 
+void CalendarStoredEvent::fetchDetails() const
+{
+    m_manager->fetchEventDetails(m_data->instanceId);
+}
+
 QString CalendarStoredEvent::color() const
 {
     return m_manager->getNotebookColor(m_data->calendarUid);
 }
 
-void CalendarStoredEvent::setEvent(const CalendarData::Event *data)
+void CalendarStoredEvent::setEvent(const CalendarData::EventPtr &data)
 {
-    if (!data)
+    // Records are immutable, the same record cannot carry changes.
+    if (!data || data == m_data)
         return;
 
-    CalendarData::Event old = *m_data;
-    *m_data = *data;
+    const CalendarData::EventPtr old = m_data;
+    if (!data->detailsLoaded && data->instanceId == old->instanceId) {
+        // Keep showing the previous details until they are fetched again.
+        CalendarData::Event *merged = new CalendarData::Event(*data);
+        merged->setDetails(*old);
+        m_data = CalendarData::EventPtr(merged);
+        if (old->detailsLoaded)
+            fetchDetails();
+    } else {
+        m_data = data;
+    }
+
+    // The hashes computed by the worker spare comparing changed values.
+    const CalendarData::Event::Properties changed = m_data->changedProperties(*old);
+    if (!changed)
+        return;
 
-    if (m_data->allDay != old.allDay)
+    if (changed & CalendarData::Event::AllDayProperty)
         emit allDayChanged();
-    if (m_data->displayLabel != old.displayLabel)
+    if (changed & CalendarData::Event::DisplayLabelProperty)
         emit displayLabelChanged();
-    if (m_data->description != old.description)
+    if (changed & CalendarData::Event::DescriptionProperty)
         emit descriptionChanged();
-    if (m_data->endTime != old.endTime)
+    if (changed & CalendarData::Event::EndTimeProperty)
         emit endTimeChanged();
-    if (m_data->location != old.location)
+    if (changed & CalendarData::Event::LocationProperty)
         emit locationChanged();
-    if (m_data->secrecy != old.secrecy)
+    if (changed & CalendarData::Event::SecrecyProperty)
         emit secrecyChanged();
-    if (m_data->status != old.status)
+    if (changed & CalendarData::Event::StatusProperty)
         emit statusChanged();
-    if (m_data->recur != old.recur)
+    if (changed & CalendarData::Event::RecurProperty)
         emit recurChanged();
-    if (m_data->reminder != old.reminder)
+    if (changed & CalendarData::Event::ReminderProperty)
         emit reminderChanged();
-    if (m_data->reminderDateTime != old.reminderDateTime)
+    if (changed & CalendarData::Event::ReminderDateTimeProperty)
         emit reminderDateTimeChanged();
-    if (m_data->startTime != old.startTime)
+    if (changed & CalendarData::Event::StartTimeProperty)
         emit startTimeChanged();
-    if (m_data->rsvp != old.rsvp)
+    if (changed & CalendarData::Event::RsvpProperty)
         emit rsvpChanged();
-    if (m_data->externalInvitation != old.externalInvitation)
+    if (changed & CalendarData::Event::ExternalInvitationProperty)
         emit externalInvitationChanged();
-    if (m_data->ownerStatus != old.ownerStatus)
+    if (changed & CalendarData::Event::OwnerStatusProperty)
         emit ownerStatusChanged();
-    if (m_data->syncFailure != old.syncFailure)
+    if (changed & CalendarData::Event::SyncFailureProperty)
         emit syncFailureChanged();
 }
 
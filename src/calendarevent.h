@@ -35,9 +35,11 @@
 
 #include <QObject>
 #include <QDateTime>
+#include <QSharedPointer>
 
 namespace CalendarData {
     struct Event;
+    typedef QSharedPointer<const Event> EventPtr;
 }
 
 class CalendarEvent : public QObject
@@ -142,6 +144,8 @@ public:
     Q_ENUM(Status)
 
     CalendarEvent(const CalendarData::Event *data, QObject *parent);
+    CalendarEvent(const CalendarData::EventPtr &data, QObject *parent);
+    // Shares the record of other
     CalendarEvent(const CalendarEvent *other, QObject *parent);
     ~CalendarEvent();
 
@@ -197,7 +201,10 @@ signals:
     void externalInvitationChanged();
 
 protected:
-    CalendarData::Event *m_data;
+    // Called when reading description or location while they are not loaded.
+    virtual void fetchDetails() const;
+
+    CalendarData::EventPtr m_data;
 };
 
 class CalendarManager;
@@ -208,20 +215,28 @@ class CalendarStoredEvent : public CalendarEvent
     Q_PROPERTY(QString color READ color NOTIFY colorChanged)
     Q_PROPERTY(CalendarStoredEvent *recurringParent READ parent CONSTANT)
 public:
-    CalendarStoredEvent(CalendarManager *manager, const CalendarData::Event *data);
+    CalendarStoredEvent(CalendarManager *manager, const CalendarData::EventPtr &data);
     ~CalendarStoredEvent();
 
     CalendarData::Event dissociateSingleOccurrence(const CalendarEventOccurrence *occurrence) const;
-    void setEvent(const CalendarData::Event *event);
+    void setEvent(const CalendarData::EventPtr &event);
     CalendarStoredEvent* parent() const;
     QString color() const;
 
+    // Returns whether the response is queued, responseSent() tells
+    // whether it went out. The owner status is saved then.
     Q_INVOKABLE bool sendResponse(int response);
     Q_INVOKABLE QString iCalendar(const QString &prodId = QString()) const;
     Q_INVOKABLE void deleteEvent();
 
 signals:
     void colorChanged();
+    void responseSent(bool sent);
+    // The instance was deleted from the calendar.
+    void removed();
+
+protected:
+    void fetchDetails() const override;
 
 private slots:
     void notebookColorChanged(QString notebookUid);
@@ -41,7 +41,9 @@ CalendarEventListModel::CalendarEventListModel(QObject *parent)
 {
     connect(CalendarManager::instance(), &CalendarManager::storageModified,
             this, &CalendarEventListModel::refresh);
-    connect(CalendarManager::instance(), &CalendarManager::dataUpdated,
+    connect(CalendarManager::instance(), &CalendarManager::dataChanged,
+            this, &CalendarEventListModel::onDataChanged);
+    connect(CalendarManager::instance(), &CalendarManager::nextOccurrencesChanged,
             this, &CalendarEventListModel::doRefresh);
     connect(CalendarManager::instance(), &CalendarManager::timezoneChanged,
             this, &CalendarEventListModel::onTimezoneChanged);
@@ -140,6 +142,20 @@ int CalendarEventListModel::rowCount(const QModelIndex &index) const
     return m_events.size();
 }
 
+void CalendarEventListModel::onDataChanged(const QList<CalendarData::Range> &ranges,
+                                           const QStringList &instanceIds, bool reset)
+{
+    Q_UNUSED(ranges);
+
+    bool changed = reset;
+    for (int i = 0; i < m_identifiers.count() && !changed; ++i)
+        changed = instanceIds.contains(m_identifiers[i]);
+
+    CalendarManager::instance()->countDataRefresh(!changed);
+    if (changed)
+        doRefresh();
+}
+
 void CalendarEventListModel::doRefresh()
 {
     beginResetModel();
@@ -151,14 +167,15 @@ void CalendarEventListModel::doRefresh()
         bool loaded;
         CalendarData::Event event = CalendarManager::instance()->getEvent(id, &loaded);
         if (event.isValid()) {
-            CalendarEventOccurrence *occurrence =
-                CalendarManager::instance()->getNextOccurrence
-                (event.instanceId, m_startTime);
-            if (occurrence->startTime().isValid()) {
+            // Still loading when the occurrence is not known yet.
+            CalendarData::EventOccurrence eo;
+            if (!CalendarManager::instance()->getNextOccurrence(event.instanceId, m_startTime, &eo))
+                continue;
+            if (eo.startTime.isValid()) {
+                CalendarEventOccurrence *occurrence = new CalendarEventOccurrence(eo);
                 occurrence->setProperty("identifier", id);
                 m_events.append(occurrence);
             } else {
-                delete occurrence;
                 m_missingItems.append(id);
             }
         } else if (loaded) {
@@ -36,6 +36,8 @@
 #include <QQmlParserStatus>
 #include <QDateTime>
 
+#include "calendardata.h"
+
 class CalendarEventOccurrence;
 
 class CalendarEventListModel : public QAbstractListModel, public QQmlParserStatus
@@ -92,6 +94,7 @@ protected:
 private slots:
     void doRefresh();
     void onTimezoneChanged();
+    void onDataChanged(const QList<CalendarData::Range> &ranges, const QStringList &instanceIds, bool reset);
 
 private:
     void refresh();
@@ -57,42 +57,76 @@ void updateTime(QDateTime *dt, Qt::TimeSpec spec, const QString &timeZone)
 
 CalendarEventModification::CalendarEventModification(const CalendarStoredEvent *source, const CalendarEventOccurrence *occurrence, QObject *parent)
     : CalendarEvent(source, parent)
+    , m_event(new CalendarData::Event(*m_data))
 {
-    if (source && occurrence)
-        *m_data = source->dissociateSingleOccurrence(occurrence);
+    // Edits go to a private copy, the shared record stays as loaded.
+    m_data = CalendarData::EventPtr(m_event);
+    if (source && occurrence) {
+        *m_event = source->dissociateSingleOccurrence(occurrence);
+    } else if (!m_event->detailsLoaded && !m_event->instanceId.isEmpty()) {
+        // Shown once received, saving before leaves the description and
+        // location as stored unless set here.
+        connect(CalendarManager::instance(), &CalendarManager::eventDetailsReceived,
+                this, &CalendarEventModification::onEventDetailsReceived);
+        CalendarManager::instance()->fetchEventDetails(m_event->instanceId);
+    }
 }
 
 CalendarEventModification::CalendarEventModification(QObject *parent)
     : CalendarEvent((CalendarData::Event*)0, parent)
+    , m_event(new CalendarData::Event)
 {
+    m_data = CalendarData::EventPtr(m_event);
 }
 
 CalendarEventModification::~CalendarEventModification()
 {
 }
 
+void CalendarEventModification::onEventDetailsReceived(const QString &instanceId,
+                                                       const CalendarData::Event &details)
+{
+    if (instanceId != m_event->instanceId)
+        return;
+
+    disconnect(CalendarManager::instance(), &CalendarManager::eventDetailsReceived,
+               this, &CalendarEventModification::onEventDetailsReceived);
+    m_event->detailsLoaded = true;
+    if (!m_descriptionSet && m_event->description != details.description) {
+        m_event->description = details.description;
+        emit descriptionChanged();
+    }
+    if (!m_locationSet && m_event->location != details.location) {
+        m_event->location = details.location;
+        emit locationChanged();
+    }
+}
+
 QDateTime CalendarEventModification::startTime() const
 {
-    return m_data->startTime;
+    return m_event->startTime;
 }
 
 QDateTime CalendarEventModification::endTime() const
 {
-    return m_data->endTime;
+    return m_event->endTime;
 }
 
 void CalendarEventModification::setDisplayLabel(const QString &displayLabel)
 {
-    if (m_data->displayLabel != displayLabel) {
-        m_data->displayLabel = displayLabel;
+    if (m_event->displayLabel != displayLabel) {
+        m_event->displayLabel = displayLabel;
         emit displayLabelChanged();
     }
 }
 
 void CalendarEventModification::setDescription(const QString &description)
 {
-    if (m_data->description != description) {
-        m_data->description = description;
+    // Written on save, even if the details were not received.
+    m_event->detailsLoaded = true;
+    m_descriptionSet = true;
+    if (m_event->description != description) {
+        m_event->description = description;
         emit descriptionChanged();
     }
 }
@@ -101,11 +135,11 @@ void CalendarEventModification::setStartTime(const QDateTime &startTime, Qt::Tim
 {
     QDateTime newStartTimeInTz = startTime;
     updateTime(&newStartTimeInTz, spec, timezone);
-    if (m_data->startTime != newStartTimeInTz
-        || m_data->startTime.timeSpec() != newStartTimeInTz.timeSpec()
-        || (m_data->startTime.timeSpec() == Qt::TimeZone
-            && m_data->startTime.timeZone() != newStartTimeInTz.timeZone())) {
-        m_data->startTime = newStartTimeInTz;
+    if (m_event->startTime != newStartTimeInTz
+        || m_event->startTime.timeSpec() != newStartTimeInTz.timeSpec()
+        || (m_event->startTime.timeSpec() == Qt::TimeZone
+            && m_event->startTime.timeZone() != newStartTimeInTz.timeZone())) {
+        m_event->startTime = newStartTimeInTz;
         emit startTimeChanged();
     }
 }
@@ -114,38 +148,38 @@ void CalendarEventModification::setEndTime(const QDateTime &endTime, Qt::TimeSpe
 {
     QDateTime newEndTimeInTz = endTime;
     updateTime(&newEndTimeInTz, spec, timezone);
-    if (m_data->endTime != newEndTimeInTz
-        || m_data->endTime.timeSpec() != newEndTimeInTz.timeSpec()
-        || (m_data->endTime.timeSpec() == Qt::TimeZone
-            && m_data->endTime.timeZone() != newEndTimeInTz.timeZone())) {
-        m_data->endTime = newEndTimeInTz;
+    if (m_event->endTime != newEndTimeInTz
+        || m_event->endTime.timeSpec() != newEndTimeInTz.timeSpec()
+        || (m_event->endTime.timeSpec() == Qt::TimeZone
+            && m_event->endTime.timeZone() != newEndTimeInTz.timeZone())) {
+        m_event->endTime = newEndTimeInTz;
         emit endTimeChanged();
     }
 }
 
 void CalendarEventModification::setAllDay(bool allDay)
 {
-    if (m_data->allDay != allDay) {
-        m_data->allDay = allDay;
+    if (m_event->allDay != allDay) {
+        m_event->allDay = allDay;
         emit allDayChanged();
     }
 }
 
 void CalendarEventModification::setRecur(CalendarEvent::Recur recur)
 {
-    if (m_data->recur != recur) {
-        m_data->recur = recur;
+    if (m_event->recur != recur) {
+        m_event->recur = recur;
         emit recurChanged();
     }
 }
 
 void CalendarEventModification::setRecurEndDate(const QDateTime &dateTime)
 {
-    bool wasValid = m_data->recurEndDate.isValid();
+    bool wasValid = m_event->recurEndDate.isValid();
     QDate date = dateTime.date();
 
-    if (m_data->recurEndDate != date) {
-        m_data->recurEndDate = date;
+    if (m_event->recurEndDate != date) {
+        m_event->recurEndDate = date;
         emit recurEndDateChanged();
 
         if (date.isValid() != wasValid) {
@@ -161,40 +195,42 @@ void CalendarEventModification::unsetRecurEndDate()
 
 void CalendarEventModification::setRecurWeeklyDays(CalendarEvent::Days days)
 {
-    if (m_data->recurWeeklyDays != days) {
-        m_data->recurWeeklyDays = days;
+    if (m_event->recurWeeklyDays != days) {
+        m_event->recurWeeklyDays = days;
         emit recurWeeklyDaysChanged();
     }
 }
 
 void CalendarEventModification::setReminder(int seconds)
 {
-    if (seconds != m_data->reminder) {
-        m_data->reminder = seconds;
+    if (seconds != m_event->reminder) {
+        m_event->reminder = seconds;
         emit reminderChanged();
     }
 }
 
 void CalendarEventModification::setReminderDateTime(const QDateTime &dateTime)
 {
-    if (dateTime != m_data->reminderDateTime) {
-        m_data->reminderDateTime = dateTime;
+    if (dateTime != m_event->reminderDateTime) {
+        m_event->reminderDateTime = dateTime;
         emit reminderDateTimeChanged();
     }
 }
 
 void CalendarEventModification::setLocation(const QString &newLocation)
 {
-    if (newLocation != m_data->location) {
-        m_data->location = newLocation;
+    m_event->detailsLoaded = true;
+    m_locationSet = true;
+    if (newLocation != m_event->location) {
+        m_event->location = newLocation;
         emit locationChanged();
     }
 }
 
 void CalendarEventModification::setCalendarUid(const QString &uid)
 {
-    if (m_data->calendarUid != uid) {
-        m_data->calendarUid = uid;
+    if (m_event->calendarUid != uid) {
+        m_event->calendarUid = uid;
         emit calendarUidChanged();
     }
 }
@@ -213,14 +249,14 @@ void CalendarEventModification::setAttendees(CalendarContactModel *required, Cal
 
 void CalendarEventModification::save()
 {
-    CalendarManager::instance()->saveModification(*m_data, m_attendeesSet,
+    CalendarManager::instance()->saveModification(*m_event, m_attendeesSet,
                                                   m_requiredAttendees, m_optionalAttendees);
 }
 
 void CalendarEventModification::setSyncFailureResolution(CalendarEvent::SyncFailureResolution resolution)
 {
-    if (m_data->syncFailureResolution != resolution) {
-        m_data->syncFailureResolution = resolution;
+    if (m_event->syncFailureResolution != resolution) {
+        m_event->syncFailureResolution = resolution;
         emit syncFailureResolutionChanged();
     }
 }
@@ -110,7 +110,15 @@ signals:
     void calendarUidChanged();
     void syncFailureResolutionChanged();
 
+private slots:
+    void onEventDetailsReceived(const QString &instanceId, const CalendarData::Event &details);
+
 private:
+    // Owned by m_data, writable view of the private record
+    CalendarData::Event *m_event;
+    // Set here, not to be replaced by the details once fetched
+    bool m_descriptionSet = false;
+    bool m_locationSet = false;
     bool m_attendeesSet = false;
     QList<CalendarData::EmailContact> m_requiredAttendees;
     QList<CalendarData::EmailContact> m_optionalAttendees;
@@ -41,7 +41,8 @@
 CalendarEventQuery::CalendarEventQuery()
     : m_isComplete(true), m_occurrence(0), m_attendeesCached(false), m_eventError(false), m_updateOccurrence(false)
 {
-    connect(CalendarManager::instance(), SIGNAL(dataUpdated()), this, SLOT(refresh()));
+    connect(CalendarManager::instance(), &CalendarManager::dataChanged,
+            this, &CalendarEventQuery::onDataChanged);
     connect(CalendarManager::instance(), SIGNAL(storageModified()), this, SLOT(refresh()));
     connect(CalendarManager::instance(), &CalendarManager::timezoneChanged,
             this, &CalendarEventQuery::onTimezoneChanged);
@@ -217,6 +218,20 @@ void CalendarEventQuery::refresh()
     CalendarManager::instance()->scheduleEventQueryRefresh(this);
 }
 
+void CalendarEventQuery::onDataChanged(const QList<CalendarData::Range> &ranges,
+                                       const QStringList &instanceIds, bool reset)
+{
+    Q_UNUSED(ranges);
+
+    if (!m_isComplete || m_instanceId.isEmpty())
+        return;
+
+    const bool changed = reset || instanceIds.contains(m_instanceId);
+    CalendarManager::instance()->countDataRefresh(!changed);
+    if (changed)
+        refresh();
+}
+
 void CalendarEventQuery::onTimezoneChanged()
 {
     if (m_occurrence) {
@@ -140,6 +140,7 @@ signals:
 private slots:
     void refresh();
     void onTimezoneChanged();
+    void onDataChanged(const QList<CalendarData::Range> &ranges, const QStringList &instanceIds, bool reset);
     void instanceIdNotified(QString oldId, QString newId, QString notebookUid);
 
 private:
@@ -39,14 +39,16 @@ CalendarImportEvent::CalendarImportEvent(const KCalendarCore::Event::Ptr &event)
     : CalendarEvent((CalendarData::Event*)0, nullptr)
     , m_color("#ffffff")
 {
+    CalendarData::Event data;
     if (event) {
-        *m_data = CalendarData::Event(*event);
+        data = CalendarData::Event(*event);
         m_organizer = event->organizer().fullName();
         m_organizerEmail = event->organizer().email();
         m_attendees = CalendarUtils::getEventAttendees(event);
         m_occurrence = CalendarUtils::getNextOccurrence(event);
     }
-    m_data->readOnly = true;
+    data.readOnly = true;
+    m_data = CalendarData::EventPtr(new CalendarData::Event(data));
 }
 
 QString CalendarImportEvent::color() const
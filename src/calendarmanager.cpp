@@ -38,27 +38,54 @@
 #include "calendarevent.h"
 #include "calendaragendamodel.h"
 #include "calendareventlistmodel.h"
+#include "calendarmonthsummarymodel.h"
 #include "calendarsearchmodel.h"
 #include "calendareventoccurrence.h"
 #include "calendareventquery.h"
 #include "calendarinvitationquery.h"
+#include "calendarutils.h"
 
 // kcalendarcore
 #include <KCalendarCore/CalFormat>
 
+// Roughly a few megabytes of cached occurrences and their events.
+static const int DefaultOccurrenceCacheLimit = 20000;
+
+// Idle time before loading neighbouring ranges, and the longest range
+// prefetched on each side of an agenda.
+static const int PrefetchDelay = 300;
+static const int PrefetchMaxDays = 42;
+// Prefetched ranges are split in chunks, a cancellation takes effect between them.
+static const int PrefetchChunkDays = 7;
+
+// Missing records read as an invalid event.
+static const CalendarData::Event &eventRecord(const CalendarData::EventPtr &event)
+{
+    static const CalendarData::Event invalid;
+    return event ? *event : invalid;
+}
+
 CalendarManager::CalendarManager()
-    : m_loadPending(false), m_resetPending(false)
+    : m_loadPending(false), m_resetPending(false), m_usageTick(0),
+      m_occurrenceCacheLimit(DefaultOccurrenceCacheLimit),
+      m_dataRefreshCount(0),
+      m_skippedDataRefreshCount(0),
+      m_agendaDedupCount(0)
 {
     qRegisterMetaType<QList<QDateTime> >("QList<QDateTime>");
     qRegisterMetaType<CalendarEvent::Recur>("CalendarEvent::Recur");
     qRegisterMetaType<QHash<QString,CalendarData::EventOccurrence> >("QHash<QString,CalendarData::EventOccurrence>");
     qRegisterMetaType<CalendarData::Event>("CalendarData::Event");
     qRegisterMetaType<QHash<QString,CalendarData::Event> >("QHash<QString,CalendarData::Event>");
-    qRegisterMetaType<QHash<QDate,QStringList> >("QHash<QDate,QStringList>");
+    qRegisterMetaType<QHash<QString,CalendarData::EventPtr> >("QHash<QString,CalendarData::EventPtr>");
+    qRegisterMetaType<QHash<CalendarData::OccurrenceKey,CalendarData::EventOccurrence> >("QHash<CalendarData::OccurrenceKey,CalendarData::EventOccurrence>");
+    qRegisterMetaType<QHash<QDate,QVector<CalendarData::OccurrenceKey> > >("QHash<QDate,QVector<CalendarData::OccurrenceKey> >");
+    qRegisterMetaType<CalendarData::LoadResultPtr>("CalendarData::LoadResultPtr");
     qRegisterMetaType<CalendarData::Range>("CalendarData::Range");
     qRegisterMetaType<QList<CalendarData::Range > >("QList<CalendarData::Range>");
     qRegisterMetaType<QList<CalendarData::Notebook> >("QList<CalendarData::Notebook>");
     qRegisterMetaType<QList<CalendarData::EmailContact> >("QList<CalendarData::EmailContact>");
+    qRegisterMetaType<QHash<QString,QString> >("QHash<QString,QString>");
 
     m_calendarWorker = new CalendarWorker();
     m_calendarWorker->moveToThread(&m_workerThread);
@@ -67,6 +94,8 @@ CalendarManager::CalendarManager()
 
     connect(m_calendarWorker, &CalendarWorker::storageModifiedSignal,
             this, &CalendarManager::storageModifiedSlot);
+    connect(m_calendarWorker, &CalendarWorker::batchCommitted,
+            this, &CalendarManager::batchCommitted);
 
     connect(m_calendarWorker, &CalendarWorker::calendarTimezoneChanged,
             this, &CalendarManager::calendarTimezoneChangedSlot);
@@ -82,12 +111,27 @@ CalendarManager::CalendarManager()
     connect(m_calendarWorker, &CalendarWorker::dataLoaded,
             this, &CalendarManager::dataLoadedSlot);
 
+    connect(m_calendarWorker, &CalendarWorker::dataPrefetched,
+            this, &CalendarManager::dataPrefetchedSlot);
+
+    connect(m_calendarWorker, &CalendarWorker::dataPatched,
+            this, &CalendarManager::dataPatchedSlot);
+
+    connect(m_calendarWorker, &CalendarWorker::nextOccurrencesFound,
+            this, &CalendarManager::nextOccurrencesFoundSlot);
+
+    connect(m_calendarWorker, &CalendarWorker::eventDetailsLoaded,
+            this, &CalendarManager::eventDetailsLoadedSlot);
+
     connect(m_calendarWorker, &CalendarWorker::searchResults,
             this, &CalendarManager::onSearchResults);
 
     connect(m_calendarWorker, &CalendarWorker::findMatchingEventFinished,
             this, &CalendarManager::findMatchingEventFinished);
 
+    connect(m_calendarWorker, &CalendarWorker::responseSent,
+            this, &CalendarManager::responseSentSlot);
+
     m_workerThread.setObjectName("calendarworker");
     m_workerThread.start();
 
@@ -97,6 +141,11 @@ CalendarManager::CalendarManager()
     m_timer->setSingleShot(true);
     m_timer->setInterval(5);
     connect(m_timer, SIGNAL(timeout()), this, SLOT(timeout()));
+
+    m_prefetchTimer = new QTimer(this);
+    m_prefetchTimer->setSingleShot(true);
+    m_prefetchTimer->setInterval(PrefetchDelay);
+    connect(m_prefetchTimer, SIGNAL(timeout()), this, SLOT(prefetch()));
 }
 
 static CalendarManager *managerInstance = nullptr;
@@ -145,9 +194,9 @@ CalendarStoredEvent* CalendarManager::eventObject(const QString &instanceId)
         return *it;
     }
 
-    const QHash<QString, CalendarData::Event>::ConstIterator event = m_events.find(instanceId);
+    const QHash<QString, CalendarData::EventPtr>::ConstIterator event = m_events.constFind(instanceId);
     if (event != m_events.constEnd()) {
-        CalendarStoredEvent *calendarEvent = new CalendarStoredEvent(this, &(*event));
+        CalendarStoredEvent *calendarEvent = new CalendarStoredEvent(this, *event);
         m_eventObjects.insert(instanceId, calendarEvent);
         return calendarEvent;
     }
@@ -155,7 +204,7 @@ CalendarStoredEvent* CalendarManager::eventObject(const QString &instanceId)
     // TODO: maybe attempt to read event from DB? This situation should not happen.
     qWarning() << Q_FUNC_INFO << "No event with uid" << instanceId << ", returning empty event";
 
-    return new CalendarStoredEvent(this, nullptr);
+    return new CalendarStoredEvent(this, CalendarData::EventPtr());
 }
 
 void CalendarManager::saveModification(CalendarData::Event eventData, bool updateAttendees,
@@ -263,9 +312,38 @@ bool CalendarManager::isSearching(const CalendarSearchModel *model) const
     return m_searchList.contains(const_cast<CalendarSearchModel*>(model));
 }
 
+void CalendarManager::countDataRefresh(bool skipped)
+{
+    if (skipped)
+        ++m_skippedDataRefreshCount;
+    else
+        ++m_dataRefreshCount;
+}
+
+int CalendarManager::dataRefreshCount() const
+{
+    return m_dataRefreshCount;
+}
+
+int CalendarManager::skippedDataRefreshCount() const
+{
+    return m_skippedDataRefreshCount;
+}
+
+int CalendarManager::agendaDedupCount() const
+{
+    return m_agendaDedupCount;
+}
+
+CalendarData::OutboundStatistics CalendarManager::outboundStatistics() const
+{
+    return m_calendarWorker->outboundStatistics();
+}
+
 void CalendarManager::cancelAgendaRefresh(CalendarAgendaModel *model)
 {
     m_agendaRefreshList.removeOne(model);
+    m_agendaViews.remove(model);
 }
 
 void CalendarManager::scheduleAgendaRefresh(CalendarAgendaModel *model)
@@ -278,6 +356,21 @@ void CalendarManager::scheduleAgendaRefresh(CalendarAgendaModel *model)
     m_timer->start();
 }
 
+void CalendarManager::cancelMonthSummaryRefresh(CalendarMonthSummaryModel *model)
+{
+    m_monthSummaryRefreshList.removeOne(model);
+}
+
+void CalendarManager::scheduleMonthSummaryRefresh(CalendarMonthSummaryModel *model)
+{
+    if (m_monthSummaryRefreshList.contains(model))
+        return;
+
+    m_monthSummaryRefreshList.append(model);
+
+    m_timer->start();
+}
+
 void CalendarManager::cancelEventListRefresh(CalendarEventListModel *model)
 {
     m_eventListRefreshList.removeOne(model);
@@ -383,75 +476,203 @@ bool CalendarManager::isRangeLoaded(const CalendarData::Range &r, QList<Calendar
     return false;
 }
 
-static bool range_lessThan(CalendarData::Range lhs, CalendarData::Range rhs)
+QList<CalendarData::Range> CalendarManager::addRanges(const QList<CalendarData::Range> &oldRanges,
+                                                      const QList<CalendarData::Range> &newRanges)
 {
-    return lhs.first < rhs.first;
+    return CalendarUtils::addRanges(oldRanges, newRanges);
 }
 
-QList<CalendarData::Range> CalendarManager::addRanges(const QList<CalendarData::Range> &oldRanges,
-                                                      const QList<CalendarData::Range> &newRanges)
+int CalendarManager::occurrenceCacheLimit() const
 {
-    if (newRanges.isEmpty() && oldRanges.isEmpty())
-        return oldRanges;
+    return m_occurrenceCacheLimit;
+}
 
-    // sort
-    QList<CalendarData::Range> sortedRanges;
-    sortedRanges.append(oldRanges);
-    sortedRanges.append(newRanges);
-    std::sort(sortedRanges.begin(), sortedRanges.end(), range_lessThan);
+void CalendarManager::setOccurrenceCacheLimit(int limit)
+{
+    m_occurrenceCacheLimit = limit;
+}
 
-    // combine
-    QList<CalendarData::Range> combinedRanges;
-    combinedRanges.append(sortedRanges.first());
+static QDate monthStart(const QDate &date)
+{
+    return QDate(date.year(), date.month(), 1);
+}
 
-    for (int i = 1; i < sortedRanges.count(); ++i) {
-        CalendarData::Range r = sortedRanges.at(i);
-        if (combinedRanges.last().second.addDays(1) >= r.first)
-            combinedRanges.last().second = qMax(combinedRanges.last().second, r.second);
-        else
-            combinedRanges.append(r);
+void CalendarManager::touchRange(const CalendarData::Range &range)
+{
+    for (QDate month = monthStart(range.first); month <= range.second; month = month.addMonths(1))
+        m_rangeUsage.insert(month, m_usageTick);
+}
+
+void CalendarManager::evictRanges()
+{
+    if (m_occurrenceCacheLimit <= 0 || m_eventOccurrences.count() <= m_occurrenceCacheLimit)
+        return;
+
+    // Loaded months, least recently used first. Months used by
+    // the current refresh round are never evicted.
+    QList<QPair<quint64, QDate> > months;
+    foreach (const CalendarData::Range &range, m_loadedRanges) {
+        for (QDate month = monthStart(range.first); month <= range.second; month = month.addMonths(1)) {
+            const quint64 usage = m_rangeUsage.value(month);
+            if (usage < m_usageTick)
+                months.append(qMakePair(usage, month));
+        }
+    }
+    std::sort(months.begin(), months.end());
+    months.erase(std::unique(months.begin(), months.end()), months.end());
+
+    QSet<CalendarData::OccurrenceKey> evicted;
+    QList<CalendarData::Range> evictedRanges;
+    int remaining = m_eventOccurrences.count();
+    for (int i = 0; i < months.count() && remaining > m_occurrenceCacheLimit; ++i) {
+        const CalendarData::Range range(months[i].second, months[i].second.addMonths(1).addDays(-1));
+        m_loadedRanges = CalendarUtils::removeRange(m_loadedRanges, range);
+        evictedRanges = addRanges(evictedRanges, QList<CalendarData::Range>() << range);
+        m_rangeUsage.remove(range.first);
+        for (QDate date = range.first; date <= range.second; date = date.addDays(1))
+            m_eventOccurrenceForDates.remove(date);
+
+        // The worker also sends the occurrences of the day before a range.
+        foreach (const CalendarData::OccurrenceKey &key, m_occurrenceIndex.occurrences(range.first.addDays(-1), range.second)) {
+            if (evicted.contains(key))
+                continue;
+            const CalendarData::EventOccurrence &eo = m_eventOccurrences[key];
+            bool retained = false;
+            foreach (const CalendarData::Range &r, m_loadedRanges) {
+                if (CalendarOccurrenceIndex::overlaps(eo, r.first, r.second)) {
+                    retained = true;
+                    break;
+                }
+            }
+            if (!retained) {
+                evicted.insert(key);
+                --remaining;
+            }
+        }
+    }
+
+    if (evictedRanges.isEmpty())
+        return;
+
+    QSet<QString> instances;
+    foreach (const CalendarData::OccurrenceKey &key, evicted)
+        instances.insert(m_eventOccurrences.take(key).instanceId);
+    m_occurrenceIndex.remove(evicted);
+
+    // Keep the events still referenced by an occurrence, a query or a live object.
+    for (QHash<CalendarData::OccurrenceKey, CalendarData::EventOccurrence>::ConstIterator it = m_eventOccurrences.constBegin();
+         it != m_eventOccurrences.constEnd(); ++it)
+        instances.remove(it->instanceId);
+    QStringList unloadedInstances;
+    foreach (const QString &instanceId, instances) {
+        if (!m_loadedQueries.contains(instanceId) && !m_eventObjects.contains(instanceId)) {
+            m_events.remove(instanceId);
+            unloadedInstances << instanceId;
+        }
     }
 
-    return combinedRanges;
+    QMetaObject::invokeMethod(m_calendarWorker, "unloadData", Qt::QueuedConnection,
+                              Q_ARG(QList<CalendarData::Range>, evictedRanges),
+                              Q_ARG(QStringList, unloadedInstances));
+    // Views still open on these months load them again.
+    emit dataChanged(evictedRanges, unloadedInstances, false);
 }
 
-void CalendarManager::updateAgendaModel(CalendarAgendaModel *model)
+void CalendarManager::updateAgendaModel(CalendarAgendaModel *model, const CalendarData::Range &range,
+                                        AgendaResults *results)
 {
-    QList<CalendarEventOccurrence*> filtered;
-    if (model->startDate() == model->endDate() || !model->endDate().isValid()) {
-        foreach (const QString &id, m_eventOccurrenceForDates.value(model->startDate())) {
-            if (m_eventOccurrences.contains(id)) {
-                filtered.append(new CalendarEventOccurrence(m_eventOccurrences.value(id)));
+    const AgendaQuery query(range, model->filterMode());
+    AgendaResults::ConstIterator it = results->constFind(query);
+    if (it != results->constEnd()) {
+        ++m_agendaDedupCount;
+        model->doRefresh(it.value());
+        return;
+    }
+
+    const QVector<CalendarData::EventOccurrence> occurrences = agendaOccurrences(range, query.second);
+    results->insert(query, occurrences);
+    model->doRefresh(occurrences);
+}
+
+QVector<CalendarData::EventOccurrence> CalendarManager::agendaOccurrences(const CalendarData::Range &range,
+                                                                          int filterMode)
+{
+    QVector<CalendarData::EventOccurrence> filtered;
+    // Position in filtered of the occurrence kept for each notebook
+    QHash<QString, int> notebookOccurrences;
+
+    // Same order as in the agenda: start time, label and instance id.
+    auto lessThan = [this](const CalendarData::EventOccurrence &o1, const CalendarData::EventOccurrence &o2) {
+        if (o1.startTime != o2.startTime)
+            return o1.startTime < o2.startTime;
+        const QByteArray label1 = eventRecord(m_events.value(o1.instanceId)).labelKey;
+        const QByteArray label2 = eventRecord(m_events.value(o2.instanceId)).labelKey;
+        if (label1 != label2)
+            return label1 < label2;
+        return QString::compare(o1.instanceId, o2.instanceId) < 0;
+    };
+    // Filtered out occurrences are never handed to the model.
+    auto append = [&](const CalendarData::EventOccurrence &occurrence) {
+        if ((filterMode & CalendarAgendaModel::FilterNonAllDay) && !occurrence.eventAllDay)
+            return;
+        if ((filterMode & CalendarAgendaModel::FilterAllDay) && occurrence.eventAllDay)
+            return;
+        if (filterMode & CalendarAgendaModel::FilterMultipleEventsPerNotebook) {
+            const CalendarData::EventPtr event = m_events.value(occurrence.instanceId);
+            const QString &calendarUid = eventRecord(event).calendarUid;
+            QHash<QString, int>::ConstIterator it = notebookOccurrences.constFind(calendarUid);
+            if (it != notebookOccurrences.constEnd()) {
+                // Coming from the index, occurrences are sorted by start time
+                // and only the ones starting together are compared further.
+                CalendarData::EventOccurrence &kept = filtered[it.value()];
+                if (lessThan(occurrence, kept))
+                    kept = occurrence;
+                return;
+            }
+            notebookOccurrences.insert(calendarUid, filtered.count());
+        }
+        filtered.append(occurrence);
+    };
+
+    if (range.first == range.second) {
+        foreach (const CalendarData::OccurrenceKey &key, m_eventOccurrenceForDates.value(range.first)) {
+            QHash<CalendarData::OccurrenceKey, CalendarData::EventOccurrence>::ConstIterator it
+                = m_eventOccurrences.constFind(key);
+            if (it != m_eventOccurrences.constEnd()) {
+                append(*it);
             } else {
-                qWarning() << "no occurrence with id" << id;
+                qWarning() << "no occurrence with id" << key.toString();
             }
         }
     } else {
-        foreach (const CalendarData::EventOccurrence &eo, m_eventOccurrences.values()) {
-            CalendarEvent *event = eventObject(eo.instanceId);
-            if (!event) {
-                qWarning() << "no event for occurrence";
-                continue;
-            }
-
-#if (QT_VERSION >= QT_VERSION_CHECK(5, 14, 0))
-            const QDateTime startDt(model->startDate().startOfDay());
-            const QDateTime endDt(model->endDate().endOfDay());
-#else
-            const QDateTime startDt(model->startDate());
-            const QDateTime endDt(QDateTime(model->endDate()).addDays(1));
-#endif
-            // on all day events the end time is inclusive, otherwise not
-            if ((eo.eventAllDay && eo.startTime.date() <= model->endDate()
-                 && eo.endTime.date() >= model->startDate())
-                || (!eo.eventAllDay && eo.startTime < endDt
-                    && eo.endTime >= startDt)) {
-                filtered.append(new CalendarEventOccurrence(eo));
-            }
+        foreach (const CalendarData::OccurrenceKey &key, m_occurrenceIndex.occurrences(range.first, range.second)) {
+            append(m_eventOccurrences.value(key));
         }
     }
 
-    model->doRefresh(filtered);
+    return filtered;
+}
+
+// Straight from the day index, without going through the agenda rows.
+QVector<CalendarData::DaySummary> CalendarManager::daySummaries(const CalendarData::Range &range) const
+{
+    QVector<CalendarData::DaySummary> days(int(range.first.daysTo(range.second)) + 1);
+    for (int i = 0; i < days.count(); ++i) {
+        CalendarData::DaySummary &day = days[i];
+        foreach (const CalendarData::OccurrenceKey &key, m_eventOccurrenceForDates.value(range.first.addDays(i))) {
+            QHash<CalendarData::OccurrenceKey, CalendarData::EventOccurrence>::ConstIterator it
+                = m_eventOccurrences.constFind(key);
+            if (it == m_eventOccurrences.constEnd())
+                continue;
+            ++day.eventCount;
+            day.hasAllDay = day.hasAllDay || it->eventAllDay;
+            const QString &notebookUid = eventRecord(m_events.value(it->instanceId)).calendarUid;
+            if (!notebookUid.isEmpty() && !day.notebookUids.contains(notebookUid))
+                day.notebookUids.append(notebookUid);
+        }
+        std::sort(day.notebookUids.begin(), day.notebookUids.end());
+    }
+    return days;
 }
 
 void CalendarManager::doAgendaAndQueryRefresh()
@@ -459,6 +680,13 @@ void CalendarManager::doAgendaAndQueryRefresh()
     QList<CalendarAgendaModel *> agendaModels = m_agendaRefreshList;
     m_agendaRefreshList.clear();
     QList<CalendarData::Range> missingRanges;
+    // Models waiting for missing data
+    QList<CalendarAgendaModel *> waitingAgendaModels;
+    QList<CalendarEventQuery *> waitingQueries;
+    QList<CalendarEventListModel *> waitingEventListModels;
+    // Shared between the models showing the same range with the same filters
+    AgendaResults agendaResults;
+    ++m_usageTick;
     foreach (CalendarAgendaModel *model, agendaModels) {
         CalendarData::Range range;
         range.first = model->startDate();
@@ -466,16 +694,48 @@ void CalendarManager::doAgendaAndQueryRefresh()
 
         if (!range.first.isValid()) {
             // need start date for fetching events, clear this model
-            model->doRefresh(QList<CalendarEventOccurrence*>());
+            model->doRefresh(QVector<CalendarData::EventOccurrence>());
             continue;
         }
+        touchRange(range);
+
+        AgendaView &view = m_agendaViews[model];
+        if (view.range.first.isValid() && view.range.first != range.first)
+            view.direction = range.first > view.range.first ? 1 : -1;
+        view.range = range;
 
         QList<CalendarData::Range> newRanges;
-        if (isRangeLoaded(range, &newRanges))
-            updateAgendaModel(model);
-        else
+        if (isRangeLoaded(range, &newRanges)) {
+            updateAgendaModel(model, range, &agendaResults);
+        } else {
             missingRanges = addRanges(missingRanges, newRanges);
+            waitingAgendaModels.append(model);
+        }
     }
+
+    const QList<CalendarMonthSummaryModel *> summaryModels = m_monthSummaryRefreshList;
+    m_monthSummaryRefreshList.clear();
+    QList<CalendarMonthSummaryModel *> waitingSummaryModels;
+    for (CalendarMonthSummaryModel *model : summaryModels) {
+        CalendarData::Range range;
+        range.first = model->startDate();
+        range.second = model->endDate().isValid() ? model->endDate() : model->startDate();
+
+        if (!range.first.isValid() || range.second < range.first) {
+            model->doRefresh(QVector<CalendarData::DaySummary>());
+            continue;
+        }
+        touchRange(range);
+
+        QList<CalendarData::Range> newRanges;
+        if (isRangeLoaded(range, &newRanges)) {
+            model->doRefresh(daySummaries(range));
+        } else {
+            missingRanges = addRanges(missingRanges, newRanges);
+            waitingSummaryModels.append(model);
+        }
+    }
+
     if (m_resetPending) {
         missingRanges = addRanges(missingRanges, m_loadedRanges);
     }
@@ -490,10 +750,12 @@ void CalendarManager::doAgendaAndQueryRefresh()
             continue;
 
         bool loaded = m_loadedQueries.contains(instanceId);
-        CalendarData::Event event = m_events.value(instanceId);
-        if (((!event.isValid() && !loaded) || m_resetPending)
-                && !missingInstanceList.contains(instanceId)) {
-            missingInstanceList << instanceId;
+        const CalendarData::EventPtr record = m_events.value(instanceId);
+        const CalendarData::Event &event = eventRecord(record);
+        if ((!event.isValid() && !loaded) || m_resetPending) {
+            if (!missingInstanceList.contains(instanceId))
+                missingInstanceList << instanceId;
+            waitingQueries.append(query);
         }
         query->doRefresh(event, !event.isValid() && loaded);
     }
@@ -506,31 +768,60 @@ void CalendarManager::doAgendaAndQueryRefresh()
                 continue;
 
             bool loaded = m_loadedQueries.contains(id);
-            CalendarData::Event event = m_events.value(id);
-            if (((!event.isValid() && !loaded) || m_resetPending)
-                && !missingInstanceList.contains(id)) {
-                missingInstanceList << id;
+            const CalendarData::EventPtr event = m_events.value(id);
+            if ((!event && !loaded) || m_resetPending) {
+                if (!missingInstanceList.contains(id))
+                    missingInstanceList << id;
+                if (!waitingEventListModels.contains(model))
+                    waitingEventListModels.append(model);
             }
         }
     }
 
     if ((!missingRanges.isEmpty() || !missingInstanceList.isEmpty())
         && !m_loadPending) {
+        cancelPrefetch();
         m_loadPending = true;
+        m_calendarWorker->notifyLoadQueued();
         QMetaObject::invokeMethod(m_calendarWorker, "loadData", Qt::QueuedConnection,
                                   Q_ARG(QList<CalendarData::Range>, missingRanges),
                                   Q_ARG(QStringList, missingInstanceList),
                                   Q_ARG(bool, m_resetPending));
         m_resetPending = false;
+    } else if (!m_loadPending) {
+        m_prefetchTimer->start();
+    } else {
+        // Retried once the ongoing load is done, as it may not contain the
+        // missing data and its dataChanged() would then be ignored.
+        foreach (CalendarAgendaModel *model, waitingAgendaModels) {
+            if (!m_agendaRefreshList.contains(model))
+                m_agendaRefreshList.append(model);
+        }
+        for (CalendarMonthSummaryModel *model : waitingSummaryModels) {
+            if (!m_monthSummaryRefreshList.contains(model))
+                m_monthSummaryRefreshList.append(model);
+        }
+        foreach (CalendarEventQuery *query, waitingQueries) {
+            if (!m_queryRefreshList.contains(query))
+                m_queryRefreshList.append(query);
+        }
+        foreach (CalendarEventListModel *model, waitingEventListModels) {
+            if (!m_eventListRefreshList.contains(model))
+                m_eventListRefreshList.append(model);
+        }
     }
 }
 
 void CalendarManager::timeout()
 {
     if (!m_agendaRefreshList.isEmpty()
+        || !m_monthSummaryRefreshList.isEmpty()
         || !m_queryRefreshList.isEmpty()
         || !m_eventListRefreshList.isEmpty() || m_resetPending)
         doAgendaAndQueryRefresh();
+    // After any load of the requested instances.
+    requestNextOccurrences();
+    requestEventDetails();
 }
 
 void CalendarManager::deleteEvent(const QString &instanceId, const QDateTime &time)
@@ -551,6 +842,24 @@ void CalendarManager::save()
     QMetaObject::invokeMethod(m_calendarWorker, "save", Qt::QueuedConnection);
 }
 
+void CalendarManager::beginBatch(int batchId)
+{
+    QMetaObject::invokeMethod(m_calendarWorker, "beginBatch", Qt::QueuedConnection,
+                              Q_ARG(int, batchId));
+}
+
+void CalendarManager::commitBatch(int batchId)
+{
+    QMetaObject::invokeMethod(m_calendarWorker, "commitBatch", Qt::QueuedConnection,
+                              Q_ARG(int, batchId));
+}
+
+void CalendarManager::abortBatch(int batchId)
+{
+    QMetaObject::invokeMethod(m_calendarWorker, "abortBatch", Qt::QueuedConnection,
+                              Q_ARG(int, batchId));
+}
+
 QString CalendarManager::convertEventToICalendarSync(const QString &instanceId, const QString &prodId)
 {
     QString vEvent;
@@ -566,17 +875,25 @@ CalendarData::Event CalendarManager::getEvent(const QString &instanceId, bool *l
     if (loaded) {
         *loaded = m_loadedQueries.contains(instanceId);
     }
+    return eventRecord(m_events.value(instanceId));
+}
+
+CalendarData::EventPtr CalendarManager::getEventRecord(const QString &instanceId) const
+{
     return m_events.value(instanceId);
 }
 
-bool CalendarManager::sendResponse(const QString &instanceId, CalendarEvent::Response response)
+void CalendarManager::sendResponse(const QString &instanceId, CalendarEvent::Response response)
 {
-    bool result;
-    QMetaObject::invokeMethod(m_calendarWorker, "sendResponse", Qt::BlockingQueuedConnection,
-                              Q_RETURN_ARG(bool, result),
+    QMetaObject::invokeMethod(m_calendarWorker, "sendResponse", Qt::QueuedConnection,
                               Q_ARG(QString, instanceId),
                               Q_ARG(CalendarEvent::Response, response));
-    return result;
+}
+
+void CalendarManager::responseSentSlot(const QString &instanceId, bool sent)
+{
+    if (CalendarStoredEvent *object = m_eventObjects.value(instanceId))
+        emit object->responseSent(sent);
 }
 
 void CalendarManager::scheduleInvitationQuery(CalendarInvitationQuery *query, const QString &invitationFile)
@@ -607,6 +924,7 @@ void CalendarManager::findMatchingEventFinished(const QString &invitationFile, c
 void CalendarManager::storageModifiedSlot()
 {
     m_resetPending = true;
+    clearNextOccurrences();
     emit storageModified();
 }
 
@@ -629,10 +947,11 @@ void CalendarManager::eventNotebookChanged(const QString &oldInstanceId,
                                            const QString &newInstanceId,
                                            const QString &notebookUid)
 {
-    if (m_events.contains(oldInstanceId)) {
-        m_events.insert(newInstanceId, m_events.value(oldInstanceId));
-        m_events[newInstanceId].calendarUid = notebookUid;
-        m_events.remove(oldInstanceId);
+    const CalendarData::EventPtr event = m_events.take(oldInstanceId);
+    if (event) {
+        CalendarData::Event *moved = new CalendarData::Event(*event);
+        moved->calendarUid = notebookUid;
+        m_events.insert(newInstanceId, CalendarData::EventPtr(moved));
     }
     // newInstanceId points to the same object than oldInstanceId
     // to avoid CalendarEventQuery or CalendarEventOccurrence to
@@ -641,6 +960,7 @@ void CalendarManager::eventNotebookChanged(const QString &oldInstanceId,
         m_eventObjects.insert(newInstanceId, m_eventObjects.value(oldInstanceId));
         m_eventObjects.remove(oldInstanceId);
     }
+    clearNextOccurrences();
     emit instanceIdChanged(oldInstanceId, newInstanceId, notebookUid);
 }
 
@@ -690,16 +1010,27 @@ void CalendarManager::notebooksChangedSlot(const QList<CalendarData::Notebook> &
     }
 }
 
+static CalendarData::EventOccurrence singleOccurrence(const CalendarData::Event &event)
+{
+    const QTimeZone systemTimeZone = QTimeZone::systemTimeZone();
+    CalendarData::EventOccurrence eo;
+    eo.instanceId = event.instanceId;
+    eo.startTime = event.startTime.toTimeZone(systemTimeZone);
+    eo.endTime = event.endTime.toTimeZone(systemTimeZone);
+    eo.eventAllDay = event.allDay;
+    return eo;
+}
+
 CalendarEventOccurrence* CalendarManager::getNextOccurrence(const QString &instanceId,
                                                             const QDateTime &start)
 {
     CalendarData::EventOccurrence eo;
-    const CalendarData::Event event = m_events.value(instanceId);
+    const CalendarData::EventPtr record = m_events.value(instanceId);
+    const CalendarData::Event &event = eventRecord(record);
     if (event.recur == CalendarEvent::RecurOnce) {
-        const QTimeZone systemTimeZone = QTimeZone::systemTimeZone();
-        eo.instanceId = event.instanceId;
-        eo.startTime = event.startTime.toTimeZone(systemTimeZone);
-        eo.endTime = event.endTime.toTimeZone(systemTimeZone);
+        eo = singleOccurrence(event);
+    } else if (m_nextOccurrences.contains(NextOccurrenceKey(instanceId, start))) {
+        eo = m_nextOccurrences.value(NextOccurrenceKey(instanceId, start));
     } else {
         QMetaObject::invokeMethod(m_calendarWorker, "getNextOccurrence", Qt::BlockingQueuedConnection,
                                   Q_RETURN_ARG(CalendarData::EventOccurrence, eo),
@@ -715,6 +1046,112 @@ CalendarEventOccurrence* CalendarManager::getNextOccurrence(const QString &insta
     return new CalendarEventOccurrence(eo);
 }
 
+bool CalendarManager::getNextOccurrence(const QString &instanceId, const QDateTime &start,
+                                        CalendarData::EventOccurrence *occurrence)
+{
+    const CalendarData::EventPtr record = m_events.value(instanceId);
+    const CalendarData::Event &event = eventRecord(record);
+    if (event.recur == CalendarEvent::RecurOnce) {
+        *occurrence = singleOccurrence(event);
+        return true;
+    }
+
+    const NextOccurrenceKey key(instanceId, start);
+    QHash<NextOccurrenceKey, CalendarData::EventOccurrence>::ConstIterator it = m_nextOccurrences.constFind(key);
+    if (it != m_nextOccurrences.constEnd()) {
+        *occurrence = *it;
+        return true;
+    }
+
+    if (!m_nextOccurrencesPending.contains(key)) {
+        m_nextOccurrencesPending.insert(key);
+        m_nextOccurrenceRequests[start].append(instanceId);
+        m_timer->start();
+    }
+    return false;
+}
+
+void CalendarManager::requestNextOccurrences()
+{
+    for (QHash<QDateTime, QStringList>::ConstIterator it = m_nextOccurrenceRequests.constBegin();
+         it != m_nextOccurrenceRequests.constEnd(); ++it) {
+        QMetaObject::invokeMethod(m_calendarWorker, "getNextOccurrences", Qt::QueuedConnection,
+                                  Q_ARG(QStringList, it.value()),
+                                  Q_ARG(QDateTime, it.key()));
+    }
+    m_nextOccurrenceRequests.clear();
+}
+
+void CalendarManager::nextOccurrencesFoundSlot(const QDateTime &start,
+                                               const QHash<QString, CalendarData::EventOccurrence> &occurrences)
+{
+    bool changed = false;
+    for (QHash<QString, CalendarData::EventOccurrence>::ConstIterator it = occurrences.constBegin();
+         it != occurrences.constEnd(); ++it) {
+        // Not pending anymore if the data changed in between, it will be requested again.
+        if (m_nextOccurrencesPending.remove(NextOccurrenceKey(it.key(), start))) {
+            m_nextOccurrences.insert(NextOccurrenceKey(it.key(), start), it.value());
+            changed = true;
+        }
+    }
+    if (changed)
+        emit nextOccurrencesChanged();
+}
+
+void CalendarManager::clearNextOccurrences()
+{
+    m_nextOccurrences.clear();
+    m_nextOccurrenceRequests.clear();
+    m_nextOccurrencesPending.clear();
+}
+
+void CalendarManager::fetchEventDetails(const QString &instanceId)
+{
+    if (m_eventDetailsPending.contains(instanceId))
+        return;
+
+    m_eventDetailsPending.insert(instanceId);
+    m_eventDetailsRequests.append(instanceId);
+    m_timer->start();
+}
+
+void CalendarManager::requestEventDetails()
+{
+    if (m_eventDetailsRequests.isEmpty())
+        return;
+
+    QMetaObject::invokeMethod(m_calendarWorker, "loadEventDetails", Qt::QueuedConnection,
+                              Q_ARG(QStringList, m_eventDetailsRequests));
+    m_eventDetailsRequests.clear();
+}
+
+void CalendarManager::eventDetailsLoadedSlot(const QStringList &instanceIds,
+                                             const QHash<QString, CalendarData::Event> &events)
+{
+    for (const QString &instanceId : instanceIds) {
+        m_eventDetailsPending.remove(instanceId);
+        const QHash<QString, CalendarData::Event>::ConstIterator details = events.constFind(instanceId);
+        if (details == events.constEnd())
+            continue;
+
+        CalendarData::EventPtr record;
+        QHash<QString, CalendarData::EventPtr>::Iterator event = m_events.find(instanceId);
+        if (event != m_events.end()) {
+            CalendarData::Event *detailed = new CalendarData::Event(**event);
+            detailed->setDetails(*details);
+            detailed->detailsLoaded = true;
+            record = CalendarData::EventPtr(detailed);
+            *event = record;
+        } else {
+            record = CalendarData::EventPtr(new CalendarData::Event(*details));
+        }
+        CalendarStoredEvent *object = m_eventObjects.value(instanceId);
+        if (object)
+            object->setEvent(record);
+        emit eventDetailsReceived(instanceId, *record);
+    }
+}
+
 QList<CalendarData::Attendee> CalendarManager::getEventAttendees(const QString &instanceId, bool *resultValid)
 {
     QList<CalendarData::Attendee> attendees;
@@ -739,41 +1176,252 @@ QList<CalendarData::Attendee> CalendarManager::getEventAttendees(const QString &
     return attendees;
 }
 
-void CalendarManager::dataLoadedSlot(const QList<CalendarData::Range> &ranges,
-                                     const QStringList &instanceList,
-                                     const QHash<QString, CalendarData::Event> &events,
-                                     const QHash<QString, CalendarData::EventOccurrence> &occurrences,
-                                     const QHash<QDate, QStringList> &dailyOccurrences,
-                                     bool reset)
+void CalendarManager::dataLoadedSlot(const CalendarData::LoadResultPtr &result)
 {
-    if (reset) {
+    if (result->reset) {
+        clearNextOccurrences();
         m_events.clear();
         m_eventOccurrences.clear();
         m_eventOccurrenceForDates.clear();
+        m_occurrenceIndex.clear();
         m_loadedRanges.clear();
         m_loadedQueries.clear();
     }
 
-    m_loadedRanges = addRanges(m_loadedRanges, ranges);
-    m_loadedQueries.append(instanceList);
-    m_events = m_events.unite(events);
-    // Use m_eventOccurrences.insert(occurrences) from Qt5.15,
-    // .unite() is deprecated and broken, it is duplicating keys.
-    for (const CalendarData::EventOccurrence &eo: occurrences)
-        m_eventOccurrences.insert(eo.getId(), eo);
-    for (QHash<QDate, QStringList>::ConstIterator it = dailyOccurrences.constBegin();
-         it != dailyOccurrences.constEnd(); ++it)
-        m_eventOccurrenceForDates.insert(it.key(), it.value());
+    m_loadedRanges = addRanges(m_loadedRanges, result->ranges);
+    m_loadedQueries.append(result->instanceList);
+    insertData(*result);
     m_loadPending = false;
 
+    evictRanges();
+
     for (QHash<QString, CalendarStoredEvent *>::ConstIterator it = m_eventObjects.constBegin();
          it != m_eventObjects.constEnd(); it++) {
-        const QHash<QString, CalendarData::Event>::ConstIterator event = m_events.find(it.key());
+        const QHash<QString, CalendarData::EventPtr>::ConstIterator event = m_events.constFind(it.key());
         if (event != m_events.constEnd()) {
-            it.value()->setEvent(&(*event));
+            it.value()->setEvent(*event);
         }
     }
 
     emit dataUpdated();
+    emit dataChanged(result->ranges, result->instanceList + result->events.keys(), result->reset);
+    m_timer->start();
+    m_prefetchTimer->start();
+}
+
+void CalendarManager::insertData(const CalendarData::LoadResult &result)
+{
+    // Adopt the loaded containers as such when there is nothing to merge
+    // them with, like after a reset, to share them instead of copying.
+    if (m_events.isEmpty()) {
+        m_events = result.events;
+    } else {
+        for (QHash<QString, CalendarData::EventPtr>::ConstIterator it = result.events.constBegin();
+             it != result.events.constEnd(); ++it)
+            m_events.insert(it.key(), it.value());
+    }
+
+    if (m_eventOccurrences.isEmpty()) {
+        m_eventOccurrences = result.occurrences;
+        for (QHash<CalendarData::OccurrenceKey, CalendarData::EventOccurrence>::ConstIterator it = m_eventOccurrences.constBegin();
+             it != m_eventOccurrences.constEnd(); ++it)
+            m_occurrenceIndex.insert(it.key(), it.value());
+    } else {
+        // Use m_eventOccurrences.insert(occurrences) from Qt5.15,
+        // .unite() is deprecated and broken, it is duplicating keys.
+        for (QHash<CalendarData::OccurrenceKey, CalendarData::EventOccurrence>::ConstIterator it = result.occurrences.constBegin();
+             it != result.occurrences.constEnd(); ++it) {
+            // Loaded ranges are extended by one day to catch overlapping
+            // occurrences, so the same occurrence may be received twice.
+            if (!m_eventOccurrences.contains(it.key()))
+                m_occurrenceIndex.insert(it.key(), it.value());
+            m_eventOccurrences.insert(it.key(), it.value());
+        }
+    }
+
+    if (m_eventOccurrenceForDates.isEmpty()) {
+        m_eventOccurrenceForDates = result.dailyOccurrences;
+    } else {
+        for (QHash<QDate, QVector<CalendarData::OccurrenceKey> >::ConstIterator it = result.dailyOccurrences.constBegin();
+             it != result.dailyOccurrences.constEnd(); ++it)
+            m_eventOccurrenceForDates.insert(it.key(), it.value());
+    }
+}
+
+void CalendarManager::dataPrefetchedSlot(const CalendarData::LoadResultPtr &result)
+{
+    foreach (const CalendarData::Range &range, result->ranges)
+        m_prefetchPendingRanges = CalendarUtils::removeRange(m_prefetchPendingRanges, range);
+    // The worker resends everything on reset.
+    if (m_resetPending)
+        return;
+
+    m_loadedRanges = addRanges(m_loadedRanges, result->ranges);
+    foreach (const CalendarData::Range &range, result->ranges)
+        touchRange(range);
+    insertData(*result);
+    evictRanges();
+    // Agendas were refreshed from already loaded ranges, nothing to update.
+}
+
+QList<CalendarData::Range> CalendarManager::prefetchRanges()
+{
+    QList<CalendarData::Range> ranges;
+    for (QHash<CalendarAgendaModel *, AgendaView>::ConstIterator it = m_agendaViews.constBegin();
+         it != m_agendaViews.constEnd(); ++it) {
+        const CalendarData::Range &range = it->range;
+        const int days = qMin(int(range.first.daysTo(range.second)) + 1, PrefetchMaxDays);
+        QList<CalendarData::Range> neighbours;
+        if (it->direction >= 0)
+            neighbours << CalendarData::Range(range.second.addDays(1), range.second.addDays(days));
+        if (it->direction <= 0)
+            neighbours << CalendarData::Range(range.first.addDays(-days), range.first.addDays(-1));
+
+        foreach (const CalendarData::Range &neighbour, neighbours) {
+            QList<CalendarData::Range> missingRanges;
+            if (!isRangeLoaded(neighbour, &missingRanges))
+                ranges = addRanges(ranges, missingRanges);
+        }
+    }
+
+    foreach (const CalendarData::Range &pending, m_prefetchPendingRanges)
+        ranges = CalendarUtils::removeRange(ranges, pending);
+
+    return ranges;
+}
+
+void CalendarManager::prefetch()
+{
+    // Foreground requests first, prefetching is resumed once they are served.
+    if (m_loadPending || m_resetPending || !m_agendaRefreshList.isEmpty()
+        || !m_monthSummaryRefreshList.isEmpty()
+        || !m_queryRefreshList.isEmpty() || !m_eventListRefreshList.isEmpty())
+        return;
+
+    const QList<CalendarData::Range> ranges = prefetchRanges();
+    if (ranges.isEmpty())
+        return;
+
+    const int generation = m_calendarWorker->prefetchGeneration();
+    foreach (const CalendarData::Range &range, ranges) {
+        for (QDate start = range.first; start <= range.second; start = start.addDays(PrefetchChunkDays)) {
+            const CalendarData::Range chunk(start, qMin(start.addDays(PrefetchChunkDays - 1), range.second));
+            QMetaObject::invokeMethod(m_calendarWorker, "prefetchData", Qt::QueuedConnection,
+                                      Q_ARG(CalendarData::Range, chunk),
+                                      Q_ARG(int, generation));
+        }
+    }
+    m_prefetchPendingRanges = addRanges(m_prefetchPendingRanges, ranges);
+}
+
+void CalendarManager::cancelPrefetch()
+{
+    m_prefetchTimer->stop();
+    if (!m_prefetchPendingRanges.isEmpty()) {
+        // Queued chunks return immediately, already sent results are still merged.
+        m_calendarWorker->cancelPrefetch();
+        m_prefetchPendingRanges.clear();
+    }
+}
+
+// Consecutive dates merged into ranges.
+static QList<CalendarData::Range> dateRanges(const QSet<QDate> &dates)
+{
+    QVector<QDate> sorted;
+    sorted.reserve(dates.count());
+    for (const QDate &date : dates)
+        sorted.append(date);
+    std::sort(sorted.begin(), sorted.end());
+    QList<CalendarData::Range> ranges;
+    for (const QDate &date : sorted) {
+        if (!ranges.isEmpty() && ranges.last().second.addDays(1) == date)
+            ranges.last().second = date;
+        else
+            ranges.append(CalendarData::Range(date, date));
+    }
+    return ranges;
+}
+
+void CalendarManager::dataPatchedSlot(const QStringList &seriesUids,
+                                      const QHash<QString, CalendarData::EventPtr> &events,
+                                      const QHash<CalendarData::OccurrenceKey, CalendarData::EventOccurrence> &occurrences,
+                                      const QHash<QDate, QVector<CalendarData::OccurrenceKey> > &dailyOccurrences)
+{
+    // Drop whatever is known about the series, the worker resent it all.
+    clearNextOccurrences();
+    QSet<QString> series;
+    for (const QString &uid : seriesUids)
+        series.insert(uid);
+    QSet<QString> staleInstances;
+    for (QHash<QString, CalendarData::EventPtr>::Iterator it = m_events.begin(); it != m_events.end();) {
+        if (series.contains((*it)->incidenceUid)) {
+            staleInstances.insert(it.key());
+            it = m_events.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    // Days showing the series, before and after the patch.
+    QSet<QDate> changedDates;
+    QSet<CalendarData::OccurrenceKey> staleOccurrences;
+    for (QHash<CalendarData::OccurrenceKey, CalendarData::EventOccurrence>::Iterator it = m_eventOccurrences.begin();
+         it != m_eventOccurrences.end();) {
+        if (staleInstances.contains(it->instanceId)) {
+            for (QDate date = it->startDate(); date <= it->endDate(); date = date.addDays(1))
+                changedDates.insert(date);
+            staleOccurrences.insert(it.key());
+            it = m_eventOccurrences.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    // One pass over each day, rather than one per removed occurrence.
+    for (const QDate &date : changedDates) {
+        QHash<QDate, QVector<CalendarData::OccurrenceKey> >::Iterator day = m_eventOccurrenceForDates.find(date);
+        if (day != m_eventOccurrenceForDates.end()) {
+            day->erase(std::remove_if(day->begin(), day->end(),
+                                      [&staleOccurrences](const CalendarData::OccurrenceKey &key) {
+                                          return staleOccurrences.contains(key);
+                                      }),
+                       day->end());
+        }
+    }
+    m_occurrenceIndex.remove(staleOccurrences);
+
+    for (QHash<QString, CalendarData::EventPtr>::ConstIterator it = events.constBegin();
+         it != events.constEnd(); ++it)
+        m_events.insert(it.key(), it.value());
+    for (QHash<CalendarData::OccurrenceKey, CalendarData::EventOccurrence>::ConstIterator it = occurrences.constBegin();
+         it != occurrences.constEnd(); ++it) {
+        m_eventOccurrences.insert(it.key(), it.value());
+        m_occurrenceIndex.insert(it.key(), it.value());
+    }
+    // The days do not list the occurrences of the series anymore.
+    for (QHash<QDate, QVector<CalendarData::OccurrenceKey> >::ConstIterator it = dailyOccurrences.constBegin();
+         it != dailyOccurrences.constEnd(); ++it) {
+        m_eventOccurrenceForDates[it.key()] += it.value();
+        changedDates.insert(it.key());
+    }
+
+    QStringList instanceIds;
+    for (QHash<QString, CalendarData::EventPtr>::ConstIterator it = events.constBegin();
+         it != events.constEnd(); ++it) {
+        CalendarStoredEvent *object = m_eventObjects.value(it.key());
+        if (object)
+            object->setEvent(it.value());
+        instanceIds << it.key();
+    }
+    for (const QString &instanceId : staleInstances) {
+        if (events.contains(instanceId))
+            continue;
+        CalendarStoredEvent *object = m_eventObjects.value(instanceId);
+        if (object)
+            emit object->removed();
+        instanceIds << instanceId;
+    }
+
+    // Loaded data stays valid, only what shows the series is refreshed.
+    emit dataUpdated();
+    emit dataChanged(dateRanges(changedDates), instanceIds, false);
     m_timer->start();
 }
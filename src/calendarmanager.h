@@ -39,9 +39,11 @@
 #include <QTimer>
 #include <QPointer>
 #include <QDateTime>
+#include <QSet>
 
 #include "calendardata.h"
 #include "calendarevent.h"
+#include "calendaroccurrenceindex.h"
 
 class CalendarWorker;
 class CalendarAgendaModel;
@@ -49,6 +51,7 @@ class CalendarEventListModel;
 class CalendarEventOccurrence;
 class CalendarEventQuery;
 class CalendarInvitationQuery;
+class CalendarMonthSummaryModel;
 class CalendarSearchModel;
 
 class CalendarManager : public QObject
@@ -69,14 +72,25 @@ public:
     void deleteEvent(const QString &instanceId, const QDateTime &dateTime);
     void deleteAll(const QString &instanceId);
     void save();
+    // Saves done between these go to storage at once, when no batch is
+    // open anymore. batchCommitted() follows for non zero batch ids.
+    void beginBatch(int batchId = 0);
+    void commitBatch(int batchId = 0);
+    void abortBatch(int batchId);
 
     // Synchronous DB thread access
     QString convertEventToICalendarSync(const QString &instanceId, const QString &prodId);
 
     // Event
     CalendarData::Event getEvent(const QString& instanceId, bool *loaded = nullptr) const;
+    // Shared record of the event, null if not loaded.
+    CalendarData::EventPtr getEventRecord(const QString &instanceId) const;
+    // Description and location of events loaded without them, the event
+    // objects are updated once received.
+    void fetchEventDetails(const QString &instanceId);
     CalendarData::Event dissociateSingleOccurrence(const QString &instanceId, const QDateTime &datetime) const;
-    bool sendResponse(const QString &instanceId, CalendarEvent::Response response);
+    // Queued, the event object gets responseSent() with the result.
+    void sendResponse(const QString &instanceId, CalendarEvent::Response response);
 
     // Notebooks
     QList<CalendarData::Notebook> notebooks();
@@ -88,10 +102,30 @@ public:
     void setNotebookColor(const QString &notebookUid, const QString &color);
     QString getNotebookColor(const QString &notebookUid) const;
 
+    // Cache budget, in number of loaded occurrences. Above it, the least
+    // recently viewed months are unloaded. 0 disables the eviction.
+    int occurrenceCacheLimit() const;
+    void setOccurrenceCacheLimit(int limit);
+
+    // Refreshes done and skipped by the models on dataChanged()
+    void countDataRefresh(bool skipped);
+    int dataRefreshCount() const;
+    int skippedDataRefreshCount() const;
+    // Agenda refreshes given the occurrences already computed for another
+    // model with the same range and filter mode in the same refresh.
+    int agendaDedupCount() const;
+
+    // Invitations and updates waiting, sent or failed
+    CalendarData::OutboundStatistics outboundStatistics() const;
+
     // AgendaModel
     void cancelAgendaRefresh(CalendarAgendaModel *model);
     void scheduleAgendaRefresh(CalendarAgendaModel *model);
 
+    // MonthSummaryModel
+    void cancelMonthSummaryRefresh(CalendarMonthSummaryModel *model);
+    void scheduleMonthSummaryRefresh(CalendarMonthSummaryModel *model);
+
     // EventListModel
     void cancelEventListRefresh(CalendarEventListModel *model);
     void scheduleEventListRefresh(CalendarEventListModel *model);
@@ -113,6 +147,11 @@ public:
     // Does synchronous DB thread access - no DB operations, though, fast when no ongoing DB ops
     CalendarEventOccurrence* getNextOccurrence(const QString &instanceId,
                                                const QDateTime &start);
+    // Asynchronous variant, returns false when the occurrence is not known yet.
+    // It is then fetched in batch with the other requests and
+    // nextOccurrencesChanged() is emitted once available.
+    bool getNextOccurrence(const QString &instanceId, const QDateTime &start,
+                           CalendarData::EventOccurrence *occurrence);
     // return attendees for given event, synchronous call
     QList<CalendarData::Attendee> getEventAttendees(const QString &instanceId, bool *resultValid);
 
@@ -124,16 +163,22 @@ private slots:
                               const QString &notebookUid);
     void excludedNotebooksChangedSlot(const QStringList &excludedNotebooks);
     void notebooksChangedSlot(const QList<CalendarData::Notebook> &notebooks);
-    void dataLoadedSlot(const QList<CalendarData::Range> &ranges,
-                        const QStringList &instanceList,
-                        const QHash<QString, CalendarData::Event> &events,
-                        const QHash<QString, CalendarData::EventOccurrence> &occurrences,
-                        const QHash<QDate, QStringList> &dailyOccurrences,
-                        bool reset);
+    void dataLoadedSlot(const CalendarData::LoadResultPtr &result);
+    void dataPrefetchedSlot(const CalendarData::LoadResultPtr &result);
+    void dataPatchedSlot(const QStringList &seriesUids,
+                         const QHash<QString, CalendarData::EventPtr> &events,
+                         const QHash<CalendarData::OccurrenceKey, CalendarData::EventOccurrence> &occurrences,
+                         const QHash<QDate, QVector<CalendarData::OccurrenceKey> > &dailyOccurrences);
     void timeout();
+    void nextOccurrencesFoundSlot(const QDateTime &start,
+                                  const QHash<QString, CalendarData::EventOccurrence> &occurrences);
+    void eventDetailsLoadedSlot(const QStringList &instanceIds,
+                                const QHash<QString, CalendarData::Event> &events);
+    void prefetch();
     void findMatchingEventFinished(const QString &invitationFile,
                                    const CalendarData::Event &event);
     void onSearchResults(const QString &searchString, const QStringList &identifiers);
+    void responseSentSlot(const QString &instanceId, bool sent);
 
 signals:
     void excludedNotebooksChanged(QStringList excludedNotebooks);
@@ -141,9 +186,19 @@ signals:
     void notebooksChanged(QList<CalendarData::Notebook> notebooks);
     void notebookColorChanged(QString notebookUid);
     void defaultNotebookChanged(QString notebookUid);
+    // The storage was modified by another process, everything is reloaded.
+    // Own saves only patch the series they touch, see dataChanged().
     void storageModified();
+    void batchCommitted(int batchId, bool saved);
+    // Description and location requested by fetchEventDetails()
+    void eventDetailsReceived(const QString &instanceId, const CalendarData::Event &details);
     void timezoneChanged();
     void dataUpdated();
+    // Emitted along dataUpdated(), with the date ranges loaded and the instances
+    // received or queried, or the days and instances of patched series.
+    // Everything is concerned on reset.
+    void dataChanged(const QList<CalendarData::Range> &ranges, const QStringList &instanceIds, bool reset);
+    void nextOccurrencesChanged();
     void instanceIdChanged(QString oldId, QString newId, QString notebookUid);
 
 private:
@@ -153,15 +208,33 @@ private:
     bool isRangeLoaded(const QPair<QDate, QDate> &r, QList<CalendarData::Range> *newRanges);
     QList<CalendarData::Range> addRanges(const QList<CalendarData::Range> &oldRanges,
                                          const QList<CalendarData::Range> &newRanges);
-    void updateAgendaModel(CalendarAgendaModel *model);
+    // Occurrences computed once per refresh for each range and filter mode
+    typedef QPair<CalendarData::Range, int> AgendaQuery;
+    typedef QHash<AgendaQuery, QVector<CalendarData::EventOccurrence> > AgendaResults;
+    void updateAgendaModel(CalendarAgendaModel *model, const CalendarData::Range &range,
+                           AgendaResults *results);
+    QVector<CalendarData::EventOccurrence> agendaOccurrences(const CalendarData::Range &range,
+                                                             int filterMode);
+    QVector<CalendarData::DaySummary> daySummaries(const CalendarData::Range &range) const;
+    void insertData(const CalendarData::LoadResult &result);
+    QList<CalendarData::Range> prefetchRanges();
+    void cancelPrefetch();
+    void requestNextOccurrences();
+    void clearNextOccurrences();
+    void requestEventDetails();
+    void touchRange(const CalendarData::Range &range);
+    void evictRanges();
 
     QThread m_workerThread;
     CalendarWorker *m_calendarWorker;
-    QHash<QString, CalendarData::Event> m_events;
+    QHash<QString, CalendarData::EventPtr> m_events;
     QHash<QString, CalendarStoredEvent *> m_eventObjects;
-    QHash<QString, CalendarData::EventOccurrence> m_eventOccurrences;
-    QHash<QDate, QStringList> m_eventOccurrenceForDates;
+    QHash<CalendarData::OccurrenceKey, CalendarData::EventOccurrence> m_eventOccurrences;
+    QHash<QDate, QVector<CalendarData::OccurrenceKey> > m_eventOccurrenceForDates;
+    // Interval index on m_eventOccurrences, for multi-day queries
+    CalendarOccurrenceIndex m_occurrenceIndex;
     QList<CalendarAgendaModel *> m_agendaRefreshList;
+    QList<CalendarMonthSummaryModel *> m_monthSummaryRefreshList;
     QList<CalendarEventListModel *> m_eventListRefreshList;
     QList<CalendarEventQuery *> m_queryRefreshList;
     QList<CalendarSearchModel *> m_searchList;
@@ -171,6 +244,18 @@ private:
 
     QTimer *m_timer;
 
+    // Agenda ranges from the last refresh, and the direction the start
+    // date moved to: 1 forward, -1 backward, 0 unknown.
+    struct AgendaView {
+        CalendarData::Range range;
+        int direction = 0;
+    };
+    QHash<CalendarAgendaModel *, AgendaView> m_agendaViews;
+    // Neighbouring ranges are loaded after this idle delay.
+    QTimer *m_prefetchTimer;
+    // Requested from the worker but not received yet
+    QList<CalendarData::Range> m_prefetchPendingRanges;
+
     // If true indicates that CalendarWorker::loadRanges(...) has been called, and the response
     // has not been received in slot CalendarManager::rangesLoaded(...)
     bool m_loadPending;
@@ -183,6 +268,27 @@ private:
 
     // A list of event instance identifiers that have been processed by CalendarWorker
     QStringList m_loadedQueries;
+
+    // Next occurrences of recurring events, by instance identifier and start time
+    typedef QPair<QString, QDateTime> NextOccurrenceKey;
+    QHash<NextOccurrenceKey, CalendarData::EventOccurrence> m_nextOccurrences;
+    // Requests not sent to the worker yet, by start time
+    QHash<QDateTime, QStringList> m_nextOccurrenceRequests;
+    // Requested occurrences not received yet
+    QSet<NextOccurrenceKey> m_nextOccurrencesPending;
+
+    // Event details to request from the worker, and the requested ones
+    QStringList m_eventDetailsRequests;
+    QSet<QString> m_eventDetailsPending;
+
+    // Last refresh round that used a month, keyed by the first day of the month
+    QHash<QDate, quint64> m_rangeUsage;
+    quint64 m_usageTick;
+    int m_occurrenceCacheLimit;
+
+    int m_dataRefreshCount;
+    int m_skippedDataRefreshCount;
+    int m_agendaDedupCount;
 };
 
 #endif // CALENDARMANAGER_H
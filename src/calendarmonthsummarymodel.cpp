@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "calendarmonthsummarymodel.h"
+
+#include "calendarmanager.h"
+
+#include <QDebug>
+
+CalendarMonthSummaryModel::CalendarMonthSummaryModel(QObject *parent)
+    : QAbstractListModel(parent), m_isComplete(true)
+{
+    connect(CalendarManager::instance(), SIGNAL(storageModified()), this, SLOT(refresh()));
+    connect(CalendarManager::instance(), &CalendarManager::dataChanged,
+            this, &CalendarMonthSummaryModel::onDataChanged);
+    connect(CalendarManager::instance(), &CalendarManager::notebookColorChanged,
+            this, &CalendarMonthSummaryModel::onNotebookColorChanged);
+}
+
+CalendarMonthSummaryModel::~CalendarMonthSummaryModel()
+{
+    CalendarManager *manager = CalendarManager::instance(false);
+    if (manager) {
+        manager->cancelMonthSummaryRefresh(this);
+    }
+}
+
+QHash<int, QByteArray> CalendarMonthSummaryModel::roleNames() const
+{
+    QHash<int,QByteArray> roleNames;
+    roleNames[DateRole] = "date";
+    roleNames[EventCountRole] = "eventCount";
+    roleNames[ColorsRole] = "colors";
+    roleNames[HasAllDayRole] = "hasAllDay";
+    return roleNames;
+}
+
+QDate CalendarMonthSummaryModel::startDate() const
+{
+    return m_startDate;
+}
+
+void CalendarMonthSummaryModel::setStartDate(const QDate &startDate)
+{
+    if (m_startDate == startDate)
+        return;
+
+    m_startDate = startDate;
+    emit startDateChanged();
+
+    refresh();
+}
+
+QDate CalendarMonthSummaryModel::endDate() const
+{
+    return m_endDate;
+}
+
+void CalendarMonthSummaryModel::setEndDate(const QDate &endDate)
+{
+    if (m_endDate == endDate)
+        return;
+
+    m_endDate = endDate;
+    emit endDateChanged();
+
+    refresh();
+}
+
+int CalendarMonthSummaryModel::count() const
+{
+    return m_days.count();
+}
+
+void CalendarMonthSummaryModel::refresh()
+{
+    if (!m_isComplete)
+        return;
+
+    CalendarManager::instance()->scheduleMonthSummaryRefresh(this);
+}
+
+void CalendarMonthSummaryModel::onDataChanged(const QList<CalendarData::Range> &ranges,
+                                              const QStringList &instanceIds, bool reset)
+{
+    Q_UNUSED(instanceIds);
+
+    if (!m_isComplete || !m_startDate.isValid())
+        return;
+
+    bool changed = reset;
+    const QDate endDate = m_endDate.isValid() ? m_endDate : m_startDate;
+    // Loaded ranges come with the occurrences overlapping them,
+    // extended by one day on both sides.
+    for (int i = 0; i < ranges.count() && !changed; ++i)
+        changed = ranges[i].first.addDays(-1) <= endDate && ranges[i].second.addDays(1) >= m_startDate;
+
+    CalendarManager::instance()->countDataRefresh(!changed);
+    if (changed)
+        refresh();
+}
+
+void CalendarMonthSummaryModel::onNotebookColorChanged(const QString &notebookUid)
+{
+    for (int i = 0; i < m_days.count(); ++i) {
+        if (m_days.at(i).notebookUids.contains(notebookUid)) {
+            const QModelIndex modelIndex = index(i, 0);
+            emit dataChanged(modelIndex, modelIndex, QVector<int>() << ColorsRole);
+        }
+    }
+}
+
+void CalendarMonthSummaryModel::doRefresh(const QVector<CalendarData::DaySummary> &days)
+{
+    const QDate daysStart = days.isEmpty() ? QDate() : m_startDate;
+    if (daysStart != m_daysStart || days.count() != m_days.count()) {
+        // Other days, the whole grid changes.
+        const int oldCount = m_days.count();
+        beginResetModel();
+        m_daysStart = daysStart;
+        m_days = days;
+        endResetModel();
+        if (oldCount != m_days.count())
+            emit countChanged();
+        emit updated();
+        return;
+    }
+
+    // Same days, only the ones having changed are notified.
+    int i = 0;
+    while (i < days.count()) {
+        if (days.at(i) == m_days.at(i)) {
+            ++i;
+            continue;
+        }
+        const int first = i;
+        while (i < days.count() && days.at(i) != m_days.at(i)) {
+            m_days[i] = days.at(i);
+            ++i;
+        }
+        emit dataChanged(index(first, 0), index(i - 1, 0),
+                         QVector<int>() << EventCountRole << ColorsRole << HasAllDayRole);
+    }
+
+    emit updated();
+}
+
+int CalendarMonthSummaryModel::rowCount(const QModelIndex &index) const
+{
+    if (index != QModelIndex())
+        return 0;
+
+    return m_days.count();
+}
+
+QVariant CalendarMonthSummaryModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid())
+        return QVariant();
+
+    return get(index.row(), role);
+}
+
+QVariant CalendarMonthSummaryModel::get(int index, int role) const
+{
+    if (index < 0 || index >= m_days.count()) {
+        qWarning() << "CalendarMonthSummaryModel: Invalid index";
+        return QVariant();
+    }
+
+    const CalendarData::DaySummary &day = m_days.at(index);
+    switch (role) {
+    case DateRole:
+        return m_daysStart.addDays(index);
+    case EventCountRole:
+        return day.eventCount;
+    case ColorsRole: {
+        QStringList colors;
+        for (const QString &notebookUid : day.notebookUids)
+            colors << CalendarManager::instance()->getNotebookColor(notebookUid);
+        return colors;
+    }
+    case HasAllDayRole:
+        return day.hasAllDay;
+    default:
+        qWarning() << "CalendarMonthSummaryModel: Unknown role asked";
+        return QVariant();
+    }
+}
+
+void CalendarMonthSummaryModel::classBegin()
+{
+    m_isComplete = false;
+}
+
+void CalendarMonthSummaryModel::componentComplete()
+{
+    m_isComplete = true;
+    refresh();
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef CALENDARMONTHSUMMARYMODEL_H
+#define CALENDARMONTHSUMMARYMODEL_H
+
+#include <QDate>
+#include <QVector>
+#include <QAbstractListModel>
+#include <QQmlParserStatus>
+
+#include "calendardata.h"
+
+// One row per day from startDate to endDate, with the number of
+// occurrences, the colors of their notebooks and whether any of them
+// is all day. Meant for month grids, no event object is created.
+class CalendarMonthSummaryModel : public QAbstractListModel, public QQmlParserStatus
+{
+    Q_OBJECT
+    Q_INTERFACES(QQmlParserStatus)
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+    Q_PROPERTY(QDate startDate READ startDate WRITE setStartDate NOTIFY startDateChanged)
+    Q_PROPERTY(QDate endDate READ endDate WRITE setEndDate NOTIFY endDateChanged)
+
+public:
+    enum SummaryRoles {
+        DateRole = Qt::UserRole,
+        EventCountRole,
+        ColorsRole,
+        HasAllDayRole
+    };
+    Q_ENUM(SummaryRoles)
+
+    explicit CalendarMonthSummaryModel(QObject *parent = 0);
+    virtual ~CalendarMonthSummaryModel();
+
+    QDate startDate() const;
+    void setStartDate(const QDate &startDate);
+
+    QDate endDate() const;
+    void setEndDate(const QDate &endDate);
+
+    int count() const;
+
+    // One summary per day from startDate, empty when the dates are invalid.
+    void doRefresh(const QVector<CalendarData::DaySummary> &days);
+
+    int rowCount(const QModelIndex &index) const;
+    QVariant data(const QModelIndex &index, int role) const;
+    Q_INVOKABLE QVariant get(int index, int role) const;
+
+    virtual void classBegin();
+    virtual void componentComplete();
+
+signals:
+    void countChanged();
+    void startDateChanged();
+    void endDateChanged();
+    void updated();
+
+protected:
+    virtual QHash<int, QByteArray> roleNames() const;
+
+private slots:
+    void refresh();
+    void onDataChanged(const QList<CalendarData::Range> &ranges, const QStringList &instanceIds, bool reset);
+    void onNotebookColorChanged(const QString &notebookUid);
+
+private:
+    QDate m_startDate;
+    QDate m_endDate;
+    QDate m_daysStart; // date of the first row
+    QVector<CalendarData::DaySummary> m_days;
+
+    bool m_isComplete;
+};
+
+#endif // CALENDARMONTHSUMMARYMODEL_H
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "calendaroccurrenceindex.h"
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+namespace {
+
+qint64 startOfDay(const QDate &date)
+{
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 14, 0))
+    return date.startOfDay().toMSecsSinceEpoch();
+#else
+    return QDateTime(date).toMSecsSinceEpoch();
+#endif
+}
+
+qint64 endOfDay(const QDate &date)
+{
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 14, 0))
+    return date.endOfDay().toMSecsSinceEpoch();
+#else
+    return QDateTime(date.addDays(1)).toMSecsSinceEpoch() - 1;
+#endif
+}
+
+}
+
+CalendarOccurrenceIndex::CalendarOccurrenceIndex()
+{
+}
+
+void CalendarOccurrenceIndex::clear()
+{
+    m_entries.clear();
+    m_maxEnd.clear();
+    m_pending.clear();
+}
+
+CalendarOccurrenceIndex::Entry CalendarOccurrenceIndex::entry(const CalendarData::EventOccurrence &occurrence)
+{
+    Entry entry;
+    // On all day events the end date is inclusive, other events are
+    // compared on their exact start and end times.
+    if (occurrence.eventAllDay) {
+        entry.start = startOfDay(occurrence.startTime.date());
+        entry.end = endOfDay(occurrence.endTime.date());
+    } else {
+        entry.start = occurrence.startTime.toMSecsSinceEpoch();
+        entry.end = occurrence.endTime.toMSecsSinceEpoch();
+    }
+    return entry;
+}
+
+void CalendarOccurrenceIndex::insert(const CalendarData::OccurrenceKey &key,
+                                     const CalendarData::EventOccurrence &occurrence)
+{
+    Entry e = entry(occurrence);
+    e.key = key;
+    m_pending.append(e);
+}
+
+bool CalendarOccurrenceIndex::overlaps(const CalendarData::EventOccurrence &occurrence,
+                                       const QDate &start, const QDate &end)
+{
+    const Entry e = entry(occurrence);
+    return e.start < endOfDay(end) && e.end >= startOfDay(start);
+}
+
+void CalendarOccurrenceIndex::remove(const QSet<CalendarData::OccurrenceKey> &keys)
+{
+    if (keys.isEmpty())
+        return;
+
+    auto removed = [&keys](const Entry &entry) {
+        return keys.contains(entry.key);
+    };
+    m_pending.erase(std::remove_if(m_pending.begin(), m_pending.end(), removed),
+                    m_pending.end());
+    const int count = m_entries.count();
+    m_entries.erase(std::remove_if(m_entries.begin(), m_entries.end(), removed),
+                    m_entries.end());
+    if (m_entries.count() != count) {
+        // Order is kept, only the subtree maxima need to be recomputed.
+        m_maxEnd.resize(m_entries.count());
+        build(0, m_entries.count());
+    }
+}
+
+int CalendarOccurrenceIndex::count() const
+{
+    return m_entries.count() + m_pending.count();
+}
+
+void CalendarOccurrenceIndex::merge()
+{
+    auto entry_lessThan = [](const Entry &lhs, const Entry &rhs) {
+        return lhs.start < rhs.start;
+    };
+
+    std::stable_sort(m_pending.begin(), m_pending.end(), entry_lessThan);
+
+    QVector<Entry> merged;
+    merged.reserve(m_entries.count() + m_pending.count());
+    std::merge(m_entries.constBegin(), m_entries.constEnd(),
+               m_pending.constBegin(), m_pending.constEnd(),
+               std::back_inserter(merged), entry_lessThan);
+    m_entries.swap(merged);
+    m_pending.clear();
+
+    m_maxEnd.resize(m_entries.count());
+    build(0, m_entries.count());
+}
+
+qint64 CalendarOccurrenceIndex::build(int begin, int end)
+{
+    if (begin >= end)
+        return std::numeric_limits<qint64>::min();
+
+    const int mid = begin + (end - begin) / 2;
+    const qint64 maxEnd = qMax(m_entries.at(mid).end,
+                               qMax(build(begin, mid), build(mid + 1, end)));
+    m_maxEnd[mid] = maxEnd;
+    return maxEnd;
+}
+
+void CalendarOccurrenceIndex::collect(int begin, int end, qint64 from, qint64 to,
+                                      QVector<CalendarData::OccurrenceKey> *result) const
+{
+    if (begin >= end)
+        return;
+
+    const int mid = begin + (end - begin) / 2;
+    // Nothing in this subtree ends after the start of the range.
+    if (m_maxEnd.at(mid) < from)
+        return;
+
+    collect(begin, mid, from, to, result);
+
+    // Entries are sorted by start, the right subtree starts too late as well.
+    const Entry &entry = m_entries.at(mid);
+    if (entry.start >= to)
+        return;
+
+    if (entry.end >= from)
+        result->append(entry.key);
+
+    collect(mid + 1, end, from, to, result);
+}
+
+QVector<CalendarData::OccurrenceKey> CalendarOccurrenceIndex::occurrences(const QDate &start, const QDate &end)
+{
+    if (!m_pending.isEmpty())
+        merge();
+
+    QVector<CalendarData::OccurrenceKey> result;
+    collect(0, m_entries.count(), startOfDay(start), endOfDay(end), &result);
+    return result;
+}
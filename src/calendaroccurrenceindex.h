@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef CALENDAROCCURRENCEINDEX_H
+#define CALENDAROCCURRENCEINDEX_H
+
+#include <QVector>
+#include <QSet>
+#include <QDate>
+
+#include "calendardata.h"
+
+// Interval index over loaded event occurrences.
+//
+// Occurrences are kept sorted by start time in an implicit, balanced
+// binary tree where every node also stores the latest end time of its
+// subtree. Looking up the occurrences overlapping a date range is then
+// O(log n + k) instead of a scan over every loaded occurrence.
+// Insertions are buffered and merged in one pass on the next lookup,
+// so that loading a range of data costs a single rebuild.
+class CalendarOccurrenceIndex
+{
+public:
+    CalendarOccurrenceIndex();
+
+    void clear();
+    void insert(const CalendarData::OccurrenceKey &key, const CalendarData::EventOccurrence &occurrence);
+    void remove(const QSet<CalendarData::OccurrenceKey> &keys);
+    int count() const;
+
+    // Returns the keys of the occurrences overlapping the
+    // [start, end] date range, both inclusive, sorted by start time.
+    QVector<CalendarData::OccurrenceKey> occurrences(const QDate &start, const QDate &end);
+
+    // Whether occurrences() would return the occurrence for that date range.
+    static bool overlaps(const CalendarData::EventOccurrence &occurrence,
+                         const QDate &start, const QDate &end);
+
+private:
+    struct Entry {
+        qint64 start;
+        qint64 end;
+        CalendarData::OccurrenceKey key;
+    };
+
+    static Entry entry(const CalendarData::EventOccurrence &occurrence);
+
+    void merge();
+    qint64 build(int begin, int end);
+    void collect(int begin, int end, qint64 from, qint64 to,
+                 QVector<CalendarData::OccurrenceKey> *result) const;
+
+    QVector<Entry> m_entries; // sorted by start time
+    QVector<qint64> m_maxEnd; // latest end time of the subtree rooted at each entry
+    QVector<Entry> m_pending;
+};
+
+#endif // CALENDAROCCURRENCEINDEX_H
@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "calendarsender.h"
+
+#include <QDebug>
+#include <QHash>
+#include <QMutexLocker>
+#include <QTimer>
+
+// mkcal
+#include <servicehandler.h>
+
+namespace {
+    // Attempts per message, and the delay before retrying failed ones, in ms.
+    const int MaxAttempts = 3;
+    const int RetryDelay = 5000;
+}
+
+CalendarSender::CalendarSender(QObject *parent)
+    : QObject(parent), m_sendScheduled(false), m_retryScheduled(false)
+{
+}
+
+CalendarSender::~CalendarSender()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_queue.isEmpty() || !m_retries.isEmpty())
+        qWarning() << "Dropping" << m_queue.count() + m_retries.count() << "unsent calendar messages";
+}
+
+void CalendarSender::sendResponse(const QString &instanceId,
+                                  const mKCal::Notebook::Ptr &notebook,
+                                  const KCalendarCore::Incidence::Ptr &incidence,
+                                  const QString &comment)
+{
+    emit responseSent(instanceId, mKCal::ServiceHandler::instance().sendResponse(notebook, incidence, comment));
+}
+
+void CalendarSender::lookupEmailAddresses(const mKCal::Notebook::List &notebooks)
+{
+    mKCal::ServiceHandler &handler = mKCal::ServiceHandler::instance();
+    QHash<QString, QString> addresses;
+    for (const mKCal::Notebook::Ptr &notebook : notebooks)
+        addresses.insert(notebook->uid(), handler.emailAddress(notebook));
+    emit emailAddressesFound(addresses);
+}
+
+void CalendarSender::enqueue(const mKCal::Notebook::Ptr &notebook,
+                             const KCalendarCore::Incidence::Ptr &incidence,
+                             Message message)
+{
+    Job job;
+    job.incidence = KCalendarCore::Incidence::Ptr(incidence->clone());
+    job.message = message;
+    job.attempts = 0;
+    job.queued.start();
+
+    QMutexLocker locker(&m_mutex);
+    // Jobs of a notebook share its copy, as long as it is queued.
+    for (const Job &queued : m_queue) {
+        if (queued.notebook->uid() == notebook->uid()) {
+            job.notebook = queued.notebook;
+            break;
+        }
+    }
+    if (!job.notebook)
+        job.notebook = mKCal::Notebook::Ptr(new mKCal::Notebook(*notebook));
+    m_queue.append(job);
+    m_statistics.backlog = m_queue.count() + m_retries.count();
+    if (!m_sendScheduled) {
+        m_sendScheduled = true;
+        QMetaObject::invokeMethod(this, "sendQueued", Qt::QueuedConnection);
+    }
+}
+
+CalendarData::OutboundStatistics CalendarSender::statistics() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_statistics;
+}
+
+void CalendarSender::retryQueued()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_retryScheduled = false;
+        m_queue = m_retries + m_queue;
+        m_retries.clear();
+    }
+    send(false);
+}
+
+void CalendarSender::sendQueued()
+{
+    send(false);
+}
+
+void CalendarSender::flush()
+{
+    QMutexLocker locker(&m_mutex);
+    m_queue = m_retries + m_queue;
+    m_retries.clear();
+    while (!m_queue.isEmpty()) {
+        locker.unlock();
+        send(true);
+        locker.relock();
+    }
+}
+
+bool CalendarSender::deliver(const mKCal::Notebook::Ptr &notebook,
+                             const KCalendarCore::Incidence::Ptr &incidence,
+                             Message message)
+{
+    mKCal::ServiceHandler &handler = mKCal::ServiceHandler::instance();
+    return message == Invitation
+            ? handler.sendInvitation(notebook, incidence, QString())
+            : handler.sendUpdate(notebook, incidence, QString());
+}
+
+void CalendarSender::send(bool lastAttempt)
+{
+    // The messages of one notebook at a time, in order of first
+    // appearance. The other ones wait for the next event loop turn,
+    // after the responses queued meanwhile.
+    QList<Job> jobs;
+    QString uid;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_sendScheduled = false;
+        if (m_queue.isEmpty())
+            return;
+        uid = m_queue.first().notebook->uid();
+        for (QList<Job>::Iterator it = m_queue.begin(); it != m_queue.end();) {
+            if (it->notebook->uid() == uid) {
+                jobs.append(*it);
+                it = m_queue.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    QList<Job> retries;
+    int sent = 0;
+    int failed = 0;
+    qint64 lastLatency = -1;
+    qint64 maxLatency = -1;
+    for (Job job : jobs) {
+        if (deliver(job.notebook, job.incidence, job.message)) {
+            ++sent;
+            lastLatency = job.queued.elapsed();
+            maxLatency = qMax(maxLatency, lastLatency);
+        } else if (++job.attempts < MaxAttempts && !lastAttempt) {
+            retries.append(job);
+        } else {
+            qWarning() << "Giving up sending message for incidence" << job.incidence->instanceIdentifier()
+                       << "of notebook" << uid;
+            ++failed;
+        }
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_statistics.sent += sent;
+    m_statistics.failed += failed;
+    m_statistics.retried += retries.count();
+    if (lastLatency >= 0) {
+        m_statistics.lastLatency = lastLatency;
+        m_statistics.maxLatency = qMax(m_statistics.maxLatency, maxLatency);
+    }
+    if (!retries.isEmpty()) {
+        m_retries += retries;
+        if (!m_retryScheduled) {
+            m_retryScheduled = true;
+            QTimer::singleShot(RetryDelay, this, &CalendarSender::retryQueued);
+        }
+    }
+    if (!m_queue.isEmpty() && !lastAttempt && !m_sendScheduled) {
+        m_sendScheduled = true;
+        QMetaObject::invokeMethod(this, "sendQueued", Qt::QueuedConnection);
+    }
+    m_statistics.backlog = m_queue.count() + m_retries.count();
+}
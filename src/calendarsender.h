@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef CALENDARSENDER_H
+#define CALENDARSENDER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QList>
+#include <QStringList>
+#include <QHash>
+#include <QElapsedTimer>
+
+// mkcal
+#include <notebook.h>
+
+#include <KCalendarCore/Incidence>
+
+#include "calendardata.h"
+
+// Sends the invitations and updates of saved events on its own thread,
+// so that a slow service plugin does not hold the worker back from
+// loading. Messages are sent grouped by notebook, failed ones are
+// retried a couple of times.
+class CalendarSender : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Message {
+        Invitation,
+        Update
+    };
+
+    explicit CalendarSender(QObject *parent = nullptr);
+    ~CalendarSender();
+
+    // Thread safe, the incidence is copied. The notebook is copied once
+    // per batch.
+    void enqueue(const mKCal::Notebook::Ptr &notebook,
+                 const KCalendarCore::Incidence::Ptr &incidence,
+                 Message message);
+    // Thread safe
+    CalendarData::OutboundStatistics statistics() const;
+
+    // mKCal::ServiceHandler is not thread safe, it is only used from the
+    // sender thread. Other threads call these with Qt::QueuedConnection,
+    // the results come with responseSent() and emailAddressesFound().
+    Q_INVOKABLE void sendResponse(const QString &instanceId,
+                                  const mKCal::Notebook::Ptr &notebook,
+                                  const KCalendarCore::Incidence::Ptr &incidence,
+                                  const QString &comment);
+    Q_INVOKABLE void lookupEmailAddresses(const mKCal::Notebook::List &notebooks);
+
+public slots:
+    void sendQueued();
+    // Sends everything left, failed messages included, before the
+    // thread stops. Messages failing again are given up.
+    void flush();
+
+signals:
+    void responseSent(const QString &instanceId, bool sent);
+    // By notebook uid
+    void emailAddressesFound(const QHash<QString, QString> &addresses);
+
+protected:
+    // Sends one message through the service plugins.
+    virtual bool deliver(const mKCal::Notebook::Ptr &notebook,
+                         const KCalendarCore::Incidence::Ptr &incidence,
+                         Message message);
+
+private:
+    friend class tst_CalendarSender;
+
+    struct Job {
+        mKCal::Notebook::Ptr notebook;
+        KCalendarCore::Incidence::Ptr incidence;
+        Message message;
+        int attempts;
+        QElapsedTimer queued;
+    };
+
+    void retryQueued();
+    void send(bool lastAttempt);
+
+    mutable QMutex m_mutex;
+    QList<Job> m_queue;
+    // Failed messages, sent again only once the retry delay is over.
+    QList<Job> m_retries;
+    bool m_sendScheduled;
+    bool m_retryScheduled;
+    CalendarData::OutboundStatistics m_statistics;
+};
+
+#endif // CALENDARSENDER_H
@@ -36,6 +36,7 @@
 // kcalendarcore
 #include <KCalendarCore/ICalFormat>
 #include <KCalendarCore/VCalFormat>
+#include <KCalendarCore/OccurrenceIterator>
 
 //mkcal
 #include <servicehandler.h>
@@ -46,6 +47,11 @@
 #include <QString>
 #include <QBitArray>
 #include <QDebug>
+#include <QThread>
+#include <QMutex>
+#include <QtConcurrent/QtConcurrentMap>
+
+#include <algorithm>
 
 CalendarData::Event::Event(const KCalendarCore::Event &event)
     : displayLabel(event.summary())
@@ -113,12 +119,14 @@ CalendarData::Event::Event(const KCalendarCore::Event &event)
 
 void CalendarData::Event::toKCalendarCore(KCalendarCore::Event::Ptr &event) const
 {
-    event->setDescription(description);
+    if (detailsLoaded) {
+        event->setDescription(description);
+        event->setLocation(location);
+    }
     event->setSummary(displayLabel);
     event->setDtStart(startTime);
     event->setDtEnd(endTime);
     event->setAllDay(allDay);
-    event->setLocation(location);
     toKReminder(*event);
     toKRecurrence(*event);
     switch (status) {
@@ -159,6 +167,105 @@ void CalendarData::Event::toKCalendarCore(KCalendarCore::Event::Ptr &event) cons
     }
 }
 
+// Positions in propertyHashes, following the bits of Event::Property.
+static const int DescriptionHashIndex = 2;
+static const int LocationHashIndex = 4;
+
+void CalendarData::Event::updateHashes()
+{
+    const uint hashes[PropertyCount] = {
+        qHash(allDay),
+        qHash(displayLabel),
+        qHash(description),
+        qHash(endTime),
+        qHash(location),
+        qHash(int(secrecy)),
+        qHash(int(status)),
+        qHash(int(recur)),
+        qHash(reminder),
+        qHash(reminderDateTime),
+        qHash(startTime),
+        qHash(rsvp),
+        qHash(externalInvitation),
+        qHash(int(ownerStatus)),
+        qHash(int(syncFailure))
+    };
+    for (int i = 0; i < PropertyCount; ++i)
+        propertyHashes[i] = hashes[i];
+    combineHashes();
+    labelKey = displayLabel.toCaseFolded().toUtf8();
+}
+
+void CalendarData::Event::combineHashes()
+{
+    uint combined = 0;
+    for (int i = 0; i < PropertyCount; ++i)
+        combined = 31 * combined + propertyHashes[i];
+    // Zero stands for records without hashes.
+    contentHash = combined ? combined : 1;
+}
+
+// Takes the description and location of other, and their hashes when
+// both records have them.
+void CalendarData::Event::setDetails(const Event &other)
+{
+    description = other.description;
+    location = other.location;
+    if (contentHash && other.contentHash) {
+        propertyHashes[DescriptionHashIndex] = other.propertyHashes[DescriptionHashIndex];
+        propertyHashes[LocationHashIndex] = other.propertyHashes[LocationHashIndex];
+        combineHashes();
+    } else if (contentHash) {
+        updateHashes();
+    }
+}
+
+// Returns the properties differing between the records. When both have
+// hashes, differing ones tell a change without comparing the values.
+// Equal ones may come from a collision, the values are compared then.
+CalendarData::Event::Properties CalendarData::Event::changedProperties(const Event &other) const
+{
+    Properties changed;
+    if (contentHash && other.contentHash) {
+        for (int i = 0; i < PropertyCount; ++i) {
+            if (propertyHashes[i] != other.propertyHashes[i])
+                changed |= Property(1 << i);
+        }
+    }
+
+    if (!(changed & AllDayProperty) && allDay != other.allDay)
+        changed |= AllDayProperty;
+    if (!(changed & DisplayLabelProperty) && displayLabel != other.displayLabel)
+        changed |= DisplayLabelProperty;
+    if (!(changed & DescriptionProperty) && description != other.description)
+        changed |= DescriptionProperty;
+    if (!(changed & EndTimeProperty) && endTime != other.endTime)
+        changed |= EndTimeProperty;
+    if (!(changed & LocationProperty) && location != other.location)
+        changed |= LocationProperty;
+    if (!(changed & SecrecyProperty) && secrecy != other.secrecy)
+        changed |= SecrecyProperty;
+    if (!(changed & StatusProperty) && status != other.status)
+        changed |= StatusProperty;
+    if (!(changed & RecurProperty) && recur != other.recur)
+        changed |= RecurProperty;
+    if (!(changed & ReminderProperty) && reminder != other.reminder)
+        changed |= ReminderProperty;
+    if (!(changed & ReminderDateTimeProperty) && reminderDateTime != other.reminderDateTime)
+        changed |= ReminderDateTimeProperty;
+    if (!(changed & StartTimeProperty) && startTime != other.startTime)
+        changed |= StartTimeProperty;
+    if (!(changed & RsvpProperty) && rsvp != other.rsvp)
+        changed |= RsvpProperty;
+    if (!(changed & ExternalInvitationProperty) && externalInvitation != other.externalInvitation)
+        changed |= ExternalInvitationProperty;
+    if (!(changed & OwnerStatusProperty) && ownerStatus != other.ownerStatus)
+        changed |= OwnerStatusProperty;
+    if (!(changed & SyncFailureProperty) && syncFailure != other.syncFailure)
+        changed |= SyncFailureProperty;
+    return changed;
+}
+
 void CalendarData::Event::toKReminder(KCalendarCore::Event &event) const
 {
     if (fromKReminder(event) == reminder
@@ -352,6 +459,113 @@ QDateTime CalendarData::Event::fromKReminderDateTime(const KCalendarCore::Event
     return QDateTime();
 }
 
+struct CalendarData::OccurrenceKey::Instance
+{
+    QString instanceId;
+    // Keys sharing the entry. Once down to zero the entry is on its way
+    // out, it is not handed out again.
+    QAtomicInt ref;
+};
+
+namespace {
+
+struct InstanceTable
+{
+    QMutex mutex;
+    QHash<QString, CalendarData::OccurrenceKey::Instance *> instances;
+};
+
+Q_GLOBAL_STATIC(InstanceTable, instanceTable)
+
+CalendarData::OccurrenceKey::Instance *acquireInstance(const QString &instanceId)
+{
+    InstanceTable *table = instanceTable();
+    QMutexLocker locker(&table->mutex);
+    CalendarData::OccurrenceKey::Instance *instance = table->instances.value(instanceId);
+    if (instance) {
+        for (int ref = instance->ref.load(); ref > 0; ref = instance->ref.load()) {
+            if (instance->ref.testAndSetOrdered(ref, ref + 1))
+                return instance;
+        }
+    }
+
+    // Replaces an entry being released, its owner deletes it.
+    instance = new CalendarData::OccurrenceKey::Instance;
+    instance->instanceId = instanceId;
+    instance->ref.store(1);
+    table->instances.insert(instanceId, instance);
+    return instance;
+}
+
+void releaseInstance(CalendarData::OccurrenceKey::Instance *instance)
+{
+    if (!instance || instance->ref.deref())
+        return;
+
+    InstanceTable *table = instanceTable();
+    {
+        QMutexLocker locker(&table->mutex);
+        QHash<QString, CalendarData::OccurrenceKey::Instance *>::Iterator it
+            = table->instances.find(instance->instanceId);
+        if (it != table->instances.end() && *it == instance)
+            table->instances.erase(it);
+    }
+    delete instance;
+}
+
+}
+
+CalendarData::OccurrenceKey::OccurrenceKey(const QString &instanceId, const QDateTime &startTime)
+    : event(acquireInstance(instanceId)), start(startTime.toMSecsSinceEpoch())
+{
+}
+
+CalendarData::OccurrenceKey::OccurrenceKey(const OccurrenceKey &other, qint64 start)
+    : event(other.event), start(start)
+{
+    if (event)
+        event->ref.ref();
+}
+
+CalendarData::OccurrenceKey::OccurrenceKey(const OccurrenceKey &other)
+    : event(other.event), start(other.start)
+{
+    if (event)
+        event->ref.ref();
+}
+
+CalendarData::OccurrenceKey::~OccurrenceKey()
+{
+    releaseInstance(event);
+}
+
+CalendarData::OccurrenceKey &CalendarData::OccurrenceKey::operator=(const OccurrenceKey &other)
+{
+    if (other.event)
+        other.event->ref.ref();
+    releaseInstance(event);
+    event = other.event;
+    start = other.start;
+    return *this;
+}
+
+QString CalendarData::OccurrenceKey::instanceId() const
+{
+    return event ? event->instanceId : QString();
+}
+
+QString CalendarData::OccurrenceKey::toString() const
+{
+    return QString("%1-%2").arg(instanceId()).arg(start);
+}
+
+int CalendarData::OccurrenceKey::internedCount()
+{
+    InstanceTable *table = instanceTable();
+    QMutexLocker locker(&table->mutex);
+    return table->instances.count();
+}
+
 QList<CalendarData::Attendee> CalendarUtils::getEventAttendees(const KCalendarCore::Incidence::Ptr &event)
 {
     QList<CalendarData::Attendee> result;
@@ -437,6 +651,60 @@ QList<QObject *> CalendarUtils::convertAttendeeList(const QList<CalendarData::At
 CalendarData::EventOccurrence CalendarUtils::getNextOccurrence(const KCalendarCore::Event::Ptr &event,
                                                                const QDateTime &start,
                                                                const KCalendarCore::Incidence::List &exceptions)
+{
+    QVector<QDateTime> recurrenceIds;
+    recurrenceIds.reserve(exceptions.count());
+    for (const KCalendarCore::Incidence::Ptr &exception : exceptions)
+        recurrenceIds.append(exception->recurrenceId());
+    std::sort(recurrenceIds.begin(), recurrenceIds.end());
+
+    return getNextOccurrence(event, start, recurrenceIds);
+}
+
+// First recurrence after (or before) from which is not an exception.
+// Most exceptions stand alone and are stepped over. Longer runs are
+// skipped with timesInInterval() over windows doubling in duration,
+// starting from the gap between two recurrences and never going past
+// the last exception, rather than one step at a time.
+static QDateTime seekOccurrence(const KCalendarCore::Recurrence *recurrence, const QDateTime &from,
+                                const QVector<QDateTime> &recurrenceIds, bool forward)
+{
+    auto step = [recurrence, forward](const QDateTime &dt) {
+        return forward ? recurrence->getNextDateTime(dt) : recurrence->getPreviousDateTime(dt);
+    };
+    auto isException = [&recurrenceIds](const QDateTime &dt) {
+        return std::binary_search(recurrenceIds.constBegin(), recurrenceIds.constEnd(), dt);
+    };
+
+    QDateTime match = step(from);
+    if (!match.isValid() || !isException(match))
+        return match;
+    QDateTime next = step(match);
+    if (!next.isValid() || !isException(next))
+        return next;
+
+    // No exception beyond the bound.
+    const QDateTime bound = forward ? recurrenceIds.last() : recurrenceIds.first();
+    for (qint64 span = qAbs(match.secsTo(next)); ; span *= 2) {
+        match = next;
+        if (match == bound)
+            return step(bound);
+        next = match.addSecs(forward ? span : -span);
+        if (forward ? next > bound : next < bound)
+            next = bound;
+        const QList<QDateTime> times = forward ? recurrence->timesInInterval(match, next)
+                                               : recurrence->timesInInterval(next, match);
+        for (int i = 0; i < times.count(); ++i) {
+            const QDateTime &dt = times.at(forward ? i : times.count() - 1 - i);
+            if (!isException(dt))
+                return dt;
+        }
+    }
+}
+
+CalendarData::EventOccurrence CalendarUtils::getNextOccurrence(const KCalendarCore::Event::Ptr &event,
+                                                               const QDateTime &start,
+                                                               const QVector<QDateTime> &recurrenceIds)
 {
     const QTimeZone systemTimeZone = QTimeZone::systemTimeZone();
 
@@ -448,27 +716,17 @@ CalendarData::EventOccurrence CalendarUtils::getNextOccurrence(const KCalendarCo
         occurrence.endTime = event->dtEnd().toTimeZone(systemTimeZone);
 
         if (!start.isNull() && event->recurs()) {
-            KCalendarCore::Recurrence *recurrence = event->recurrence();
-            QSet<QDateTime> recurrenceIds;
-            for (const KCalendarCore::Incidence::Ptr &exception : exceptions)
-                recurrenceIds.insert(exception->recurrenceId());
+            const KCalendarCore::Recurrence *recurrence = event->recurrence();
             const KCalendarCore::Duration period(event->dtStart(), event->dtEnd());
 
             QDateTime match;
-            if (recurrence->recursAt(start) && !recurrenceIds.contains(start))
-                match = start;
-            if (match.isNull()) {
+            if (recurrence->recursAt(start)
+                && !std::binary_search(recurrenceIds.constBegin(), recurrenceIds.constEnd(), start))
                 match = start;
-                do {
-                    match = recurrence->getNextDateTime(match);
-                } while (match.isValid() && recurrenceIds.contains(match));
-            }
-            if (match.isNull()) {
-                match = start;
-                do {
-                    match = recurrence->getPreviousDateTime(match);
-                } while (match.isValid() && recurrenceIds.contains(match));
-            }
+            if (match.isNull())
+                match = seekOccurrence(recurrence, start, recurrenceIds, true);
+            if (match.isNull())
+                match = seekOccurrence(recurrence, start, recurrenceIds, false);
             if (match.isValid()) {
                 occurrence.startTime = match.toTimeZone(systemTimeZone);
                 occurrence.endTime = period.end(match).toTimeZone(systemTimeZone);
@@ -569,3 +827,111 @@ QString CalendarUtils::recurrenceIdToString(const QDateTime &dt)
     // same string format for recurrence ids.
     return dt.toOffsetFromUtc(dt.offsetFromUtc()).toString(Qt::ISODate);
 }
+
+static bool range_lessThan(CalendarData::Range lhs, CalendarData::Range rhs)
+{
+    return lhs.first < rhs.first;
+}
+
+QList<CalendarData::Range> CalendarUtils::addRanges(const QList<CalendarData::Range> &oldRanges,
+                                                    const QList<CalendarData::Range> &newRanges)
+{
+    if (newRanges.isEmpty() && oldRanges.isEmpty())
+        return oldRanges;
+
+    // sort
+    QList<CalendarData::Range> sortedRanges;
+    sortedRanges.append(oldRanges);
+    sortedRanges.append(newRanges);
+    std::sort(sortedRanges.begin(), sortedRanges.end(), range_lessThan);
+
+    // combine
+    QList<CalendarData::Range> combinedRanges;
+    combinedRanges.append(sortedRanges.first());
+
+    for (int i = 1; i < sortedRanges.count(); ++i) {
+        CalendarData::Range r = sortedRanges.at(i);
+        if (combinedRanges.last().second.addDays(1) >= r.first)
+            combinedRanges.last().second = qMax(combinedRanges.last().second, r.second);
+        else
+            combinedRanges.append(r);
+    }
+
+    return combinedRanges;
+}
+
+QList<CalendarData::Range> CalendarUtils::removeRange(const QList<CalendarData::Range> &ranges,
+                                                      const CalendarData::Range &range)
+{
+    QList<CalendarData::Range> remainingRanges;
+    for (const CalendarData::Range &r : ranges) {
+        if (r.second < range.first || r.first > range.second) {
+            remainingRanges.append(r);
+            continue;
+        }
+        if (r.first < range.first)
+            remainingRanges.append(CalendarData::Range(r.first, range.first.addDays(-1)));
+        if (r.second > range.second)
+            remainingRanges.append(CalendarData::Range(range.second.addDays(1), r.second));
+    }
+
+    return remainingRanges;
+}
+
+namespace {
+
+// Below this amount of series, the thread pool overhead is not worth it.
+const int ParallelExpansionThreshold = 64;
+
+struct SeriesExpander
+{
+    typedef QList<CalendarUtils::Occurrence> result_type;
+
+    SeriesExpander(const KCalendarCore::Calendar &calendar, const QDateTime &start, const QDateTime &end)
+        : calendar(calendar), start(start), end(end)
+    {
+    }
+
+    QList<CalendarUtils::Occurrence> operator()(const KCalendarCore::Incidence::List &series) const
+    {
+        QList<CalendarUtils::Occurrence> occurrences;
+        for (const KCalendarCore::Incidence::Ptr &incidence : series) {
+            KCalendarCore::OccurrenceIterator it(calendar, incidence, start, end);
+            while (it.hasNext()) {
+                it.next();
+                occurrences.append(CalendarUtils::Occurrence(it.incidence(), it.occurrenceStartDate()));
+            }
+        }
+        return occurrences;
+    }
+
+    const KCalendarCore::Calendar &calendar;
+    QDateTime start;
+    QDateTime end;
+};
+
+}
+
+QList<CalendarUtils::Occurrence> CalendarUtils::expandOccurrences(const KCalendarCore::Calendar &calendar,
+                                                                  const KCalendarCore::Incidence::List &series,
+                                                                  const QDateTime &start, const QDateTime &end,
+                                                                  bool parallel)
+{
+    const SeriesExpander expand(calendar, start, end);
+    if (!parallel || series.count() < ParallelExpansionThreshold)
+        return expand(series);
+
+    // A few chunks per core, to balance series of very different lengths.
+    const int chunkCount = qMax(1, QThread::idealThreadCount()) * 4;
+    const int chunkSize = (series.count() + chunkCount - 1) / chunkCount;
+    QList<KCalendarCore::Incidence::List> chunks;
+    for (int i = 0; i < series.count(); i += chunkSize)
+        chunks.append(series.mid(i, chunkSize));
+
+    // Mapped results keep the chunk order, the merge is deterministic.
+    const QList<QList<Occurrence> > results = QtConcurrent::blockingMapped(chunks, expand);
+    QList<Occurrence> occurrences;
+    for (const QList<Occurrence> &result : results)
+        occurrences.append(result);
+    return occurrences;
+}
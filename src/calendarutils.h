@@ -38,6 +38,8 @@
 #include "calendarevent.h"
 #include "calendardata.h"
 
+#include <QVector>
+
 // KCalendarCore
 #include <KCalendarCore/Event>
 #include <KCalendarCore/Calendar>
@@ -49,11 +51,28 @@ QList<QObject*> convertAttendeeList(const QList<CalendarData::Attendee> &list);
 CalendarData::EventOccurrence getNextOccurrence(const KCalendarCore::Event::Ptr &event,
                                                 const QDateTime &start = QDateTime::currentDateTime(),
                                                 const KCalendarCore::Incidence::List &exceptions = KCalendarCore::Incidence::List());
+// Same, with the sorted recurrence ids of the exceptions of the series.
+CalendarData::EventOccurrence getNextOccurrence(const KCalendarCore::Event::Ptr &event,
+                                                const QDateTime &start,
+                                                const QVector<QDateTime> &recurrenceIds);
 bool importFromFile(const QString &fileName, KCalendarCore::Calendar::Ptr calendar);
 bool importFromIcsRawData(const QByteArray &icsData, KCalendarCore::Calendar::Ptr calendar);
 CalendarEvent::Response convertPartStat(KCalendarCore::Attendee::PartStat status);
 CalendarEvent::Response convertResponseType(const QString &responseType);
 QString recurrenceIdToString(const QDateTime &dt);
+QList<CalendarData::Range> addRanges(const QList<CalendarData::Range> &oldRanges,
+                                     const QList<CalendarData::Range> &newRanges);
+QList<CalendarData::Range> removeRange(const QList<CalendarData::Range> &ranges,
+                                       const CalendarData::Range &range);
+
+typedef QPair<KCalendarCore::Incidence::Ptr, QDateTime> Occurrence;
+// Occurrences of the given series between start and end, series after series.
+// Series are expanded concurrently, each one on a single thread since
+// KCalendarCore keeps recurrence caches per incidence.
+QList<Occurrence> expandOccurrences(const KCalendarCore::Calendar &calendar,
+                                    const KCalendarCore::Incidence::List &series,
+                                    const QDateTime &start, const QDateTime &end,
+                                    bool parallel = true);
 
 } // namespace CalendarUtils
 
@@ -32,13 +32,16 @@
 
 #include "calendarworker.h"
 #include "calendarutils.h"
+#include "calendarsender.h"
 
 #include <QDebug>
 #include <QSettings>
+#include <QThread>
+#include <QTimer>
+#include <QtConcurrent/QtConcurrentMap>
 
 // mkcal
 #include <notebook.h>
-#include <servicehandler.h>
 
 // KCalendarCore
 #include <KCalendarCore/Attendee>
@@ -48,7 +51,7 @@
 #include <KCalendarCore/Recurrence>
 #include <KCalendarCore/RecurrenceRule>
 #include <KCalendarCore/MemoryCalendar>
-#include <KCalendarCore/OccurrenceIterator>
+#include <KCalendarCore/CalFilter>
 
 // libaccounts-qt
 #include <Accounts/Manager>
@@ -72,17 +75,61 @@ namespace {
         }
         event->setAttendees(allAttendees);
     }
+
+    // Below this amount of events, the thread pool overhead is not worth it.
+    const int ParallelConversionThreshold = 64;
+
+    // Idle time before writing the queued modifications, in ms.
+    const int SaveDelay = 300;
+    // Times the write is postponed in favour of a load, at most.
+    const int MaxSaveDeferrals = 10;
+    // Time without begin or commit after which an open batch is given
+    // up, its changes being saved, in ms.
+    const int BatchTimeout = 30000;
+
+    struct EventConverter
+    {
+        typedef QList<CalendarData::EventPtr> result_type;
+
+        QList<CalendarData::EventPtr> operator()(const QList<CalendarWorker::EventSource> &sources) const
+        {
+            QList<CalendarData::EventPtr> events;
+            for (const CalendarWorker::EventSource &source : sources)
+                events.append(CalendarData::EventPtr(new CalendarData::Event(CalendarWorker::createEventStruct(source))));
+            return events;
+        }
+    };
 }
 
 CalendarWorker::CalendarWorker()
-    : QObject(0), m_accountManager(0)
+    : QObject(0), m_accountManager(0), m_batchSavePending(false), m_batchTimer(0)
+    , m_unsavedChanges(false), m_saveTimer(0), m_saveDeferrals(0), m_sender(new CalendarSender)
 {
+    // Created here rather than in init(), other threads read its
+    // statistics from the start.
+    m_sender->moveToThread(&m_senderThread);
+    m_senderThread.setObjectName("calendarsender");
+    m_senderThread.start();
+    connect(m_sender, &CalendarSender::responseSent, this, &CalendarWorker::responseDelivered);
+    connect(m_sender, &CalendarSender::emailAddressesFound, this, &CalendarWorker::emailAddressesFound);
 }
 
 CalendarWorker::~CalendarWorker()
 {
-    if (m_storage.data())
+    if (m_storage.data()) {
+        // Nothing waiting to be written is lost, open batches included.
+        m_openBatches.clear();
+        if (m_batchSavePending || hasUnsavedChanges())
+            saveStorage();
         m_storage->close();
+    }
+
+    // Whatever the thread did not get to is sent before it stops,
+    // including the messages waiting for a retry.
+    QMetaObject::invokeMethod(m_sender, "flush", Qt::BlockingQueuedConnection);
+    m_senderThread.quit();
+    m_senderThread.wait();
+    delete m_sender;
 
     m_calendar.clear();
     m_storage.clear();
@@ -95,10 +142,44 @@ void CalendarWorker::storageModified(mKCal::ExtendedStorage *storage, const QStr
 
     // External touch of the database. We have no clue what changed.
     // The m_calendar content has been wiped out already.
+    m_recurrenceIds.clear();
     loadNotebooks();
+
+    // Own changes not saved yet went with it, write them again on top
+    // of the new content, before the queued ones.
+    if (!m_unsavedSaves.isEmpty() || !m_unsavedDeletions.isEmpty()) {
+        const QList<PendingSave> pendingSaves = m_pendingSaves;
+        const QList<PendingDeletion> deletions = m_unsavedDeletions;
+        m_pendingSaves = m_unsavedSaves;
+        m_unsavedSaves.clear();
+        m_unsavedDeletions.clear();
+        m_unsavedChanges = false;
+        applyPendingSaves();
+        for (const PendingDeletion &deletion : deletions) {
+            if (deletion.all)
+                deleteAll(deletion.instanceId);
+            else
+                deleteEvent(deletion.instanceId, deletion.dateTime);
+        }
+        m_pendingSaves = pendingSaves;
+    }
     emit storageModifiedSignal();
 }
 
+void CalendarWorker::calendarIncidenceAdded(const KCalendarCore::Incidence::Ptr &incidence)
+{
+    // The notebook may not be set yet, events are filtered when sent.
+    m_addedInstances.insert(incidence->instanceIdentifier());
+}
+
+void CalendarWorker::calendarIncidenceDeleted(const KCalendarCore::Incidence::Ptr &incidence,
+                                              const KCalendarCore::Calendar *calendar)
+{
+    Q_UNUSED(calendar);
+
+    m_addedInstances.remove(incidence->instanceIdentifier());
+}
+
 void CalendarWorker::storageUpdated(mKCal::ExtendedStorage *storage,
                                     const KCalendarCore::Incidence::List &added,
                                     const KCalendarCore::Incidence::List &modified,
@@ -114,7 +195,7 @@ void CalendarWorker::storageUpdated(mKCal::ExtendedStorage *storage,
         if (event->attendeeCount() > 0) {
             mKCal::Notebook::Ptr notebook = m_storage->notebook(m_calendar->notebook(event));
             if (notebook) {
-                mKCal::ServiceHandler::instance().sendInvitation(notebook, event, QString());
+                m_sender->enqueue(notebook, event, CalendarSender::Invitation);
             } else {
                 qWarning() << "Failed to load notebook for incidence" << event->instanceIdentifier();
             }
@@ -124,35 +205,99 @@ void CalendarWorker::storageUpdated(mKCal::ExtendedStorage *storage,
         if (event->attendeeCount() > 0 && isOrganizer(event)) {
             mKCal::Notebook::Ptr notebook = m_storage->notebook(m_calendar->notebook(event));
             if (notebook) {
-                mKCal::ServiceHandler::instance().sendUpdate(notebook, event, QString());
+                m_sender->enqueue(notebook, event, CalendarSender::Update);
             } else {
                 qWarning() << "Failed to load notebook for incidence" << event->instanceIdentifier();
             }
         }
     }
 
+    QHash<QString, KCalendarCore::Incidence::List> purged;
     for (const KCalendarCore::Incidence::Ptr &event: deleted) {
         // FIXME: should send response update if deleting an event we have responded to.
         if (event->attendeeCount() > 0 && isOrganizer(event)) {
             event->setStatus(KCalendarCore::Incidence::StatusCanceled);
             mKCal::Notebook::Ptr notebook = m_storage->notebook(m_calendar->notebook(event));
             if (notebook) {
-                mKCal::ServiceHandler::instance().sendUpdate(notebook, event, QString());
+                m_sender->enqueue(notebook, event, CalendarSender::Update);
             } else {
                 qWarning() << "Failed to load notebook for incidence" << event->instanceIdentifier();
             }
         }
         // if the event was stored in a local (non-synced) notebook, purge it.
         const CalendarData::Notebook &notebook = m_notebooks.value(m_calendar->notebook(event));
-        if (notebook.localCalendar
-            && !storage->purgeDeletedIncidences(KCalendarCore::Incidence::List() << event, notebook.uid)) {
-            qWarning() << "Failed to purge deleted event" << event->uid()
-                       << "from local calendar" << m_calendar->notebook(event);
+        if (notebook.localCalendar)
+            purged[notebook.uid].append(event);
+    }
+    // One purge per notebook.
+    for (QHash<QString, KCalendarCore::Incidence::List>::ConstIterator it = purged.constBegin();
+         it != purged.constEnd(); ++it) {
+        if (!storage->purgeDeletedIncidences(it.value(), it.key())) {
+            qWarning() << "Failed to purge" << it.value().count()
+                       << "deleted events from local calendar" << it.key();
         }
     }
 
-    // No smart handling of known updates at the moment.
-    emit storageModifiedSignal();
+    // Our own saves, the calendar content is still valid: resend only
+    // the touched series instead of letting the manager reload everything.
+    sendSeriesUpdate(added, modified, deleted);
+}
+
+void CalendarWorker::sendSeriesUpdate(const KCalendarCore::Incidence::List &added,
+                                      const KCalendarCore::Incidence::List &modified,
+                                      const KCalendarCore::Incidence::List &deleted)
+{
+    m_notebookContexts.clear();
+    QStringList uids;
+    for (const KCalendarCore::Incidence::Ptr &incidence : added + modified + deleted) {
+        if (incidence->type() == KCalendarCore::IncidenceBase::TypeEvent
+            && !uids.contains(incidence->uid())) {
+            uids.append(incidence->uid());
+        }
+    }
+    if (uids.isEmpty()) {
+        return;
+    }
+
+    for (const KCalendarCore::Incidence::Ptr &incidence : deleted) {
+        m_sentEvents.remove(incidence->instanceIdentifier());
+    }
+    for (const QString &uid : uids) {
+        m_recurrenceIds.remove(uid);
+    }
+
+    KCalendarCore::Incidence::List series;
+    QHash<QString, CalendarData::EventPtr> events;
+    for (const QString &uid : uids) {
+        KCalendarCore::Incidence::Ptr parent = m_calendar->incidence(uid);
+        if (!parent) {
+            continue;
+        }
+        series.append(parent);
+
+        const KCalendarCore::Incidence::List instances
+            = KCalendarCore::Incidence::List() << parent << m_calendar->instances(parent);
+        for (const KCalendarCore::Incidence::Ptr &incidence : instances) {
+            const QString id = incidence->instanceIdentifier();
+            m_sentEvents.remove(id);
+            if (incidence->type() != KCalendarCore::IncidenceBase::TypeEvent
+                || !m_calendar->isVisible(incidence)) {
+                continue;
+            }
+            if (!notebookContext(m_calendar->notebook(incidence)).exists) {
+                continue;
+            }
+            events.insert(id, CalendarData::EventPtr(new CalendarData::Event(createEventStruct(incidence.staticCast<KCalendarCore::Event>()))));
+            m_sentEvents.insert(id);
+        }
+    }
+
+    const QHash<CalendarData::OccurrenceKey, CalendarData::EventOccurrence> occurrences
+        = seriesOccurrences(m_loadedRanges, series);
+    const QHash<QDate, QVector<CalendarData::OccurrenceKey> > dailyOccurrences
+        = dailyEventOccurrences(m_loadedRanges, occurrences);
+
+    emit dataPatched(uids, events, occurrences, dailyOccurrences);
 }
 
 KCalendarCore::Incidence::Ptr CalendarWorker::getInstance(const QString &instanceId) const
@@ -160,12 +305,14 @@ KCalendarCore::Incidence::Ptr CalendarWorker::getInstance(const QString &instanc
     KCalendarCore::Incidence::Ptr event = m_calendar->instance(instanceId);
     if (!event && m_storage->loadIncidenceInstance(instanceId)) {
         event = m_calendar->instance(instanceId);
+        m_recurrenceIds.clear();
     }
     return event;
 }
 
 void CalendarWorker::deleteEvent(const QString &instanceId, const QDateTime &dateTime)
 {
+    applyPendingSaves();
     KCalendarCore::Incidence::Ptr event = getInstance(instanceId);
     if (!event) {
         qDebug() << instanceId << "event already deleted from DB";
@@ -192,10 +339,13 @@ void CalendarWorker::deleteEvent(const QString &instanceId, const QDateTime &dat
     } else {
         m_calendar->deleteIncidence(event);
     }
+    m_unsavedChanges = true;
+    m_unsavedDeletions.append(PendingDeletion { instanceId, dateTime, false });
 }
 
 void CalendarWorker::deleteAll(const QString &instanceId)
 {
+    applyPendingSaves();
     KCalendarCore::Incidence::Ptr event = getInstance(instanceId);
     if (!event) {
         qDebug() << instanceId << "event already deleted from DB";
@@ -207,53 +357,87 @@ void CalendarWorker::deleteAll(const QString &instanceId)
             event = parent;
     }
     m_calendar->deleteIncidence(event);
+    m_unsavedChanges = true;
+    m_unsavedDeletions.append(PendingDeletion { instanceId, QDateTime(), true });
 }
 
-bool CalendarWorker::sendResponse(const QString &instanceId,
+void CalendarWorker::sendResponse(const QString &instanceId,
                                   const CalendarEvent::Response response)
 {
-    KCalendarCore::Incidence::Ptr event = m_calendar->instance(instanceId);
+    applyPendingSaves();
+    KCalendarCore::Incidence::Ptr event = getInstance(instanceId);
     if (!event) {
         qWarning() << "Failed to send response, event not found. UID = " << instanceId;
-        return false;
+        emit responseSent(instanceId, false);
+        return;
+    }
+    mKCal::Notebook::Ptr notebook = m_storage->notebook(m_calendar->notebook(event));
+    if (!notebook) {
+        qWarning() << "Failed to load notebook for incidence" << instanceId;
+        emit responseSent(instanceId, false);
+        return;
     }
     const QString ownerEmail = getNotebookAddress(m_calendar->notebook(event));
-    const KCalendarCore::Attendee origAttendee = event->attendeeByMail(ownerEmail);
-    KCalendarCore::Attendee updated = origAttendee;
+    PendingResponse pending;
+    pending.instanceId = instanceId;
+    pending.original = event->attendeeByMail(ownerEmail);
+    pending.updated = pending.original;
     switch (response) {
     case CalendarEvent::ResponseAccept:
-        updated.setStatus(KCalendarCore::Attendee::Accepted);
+        pending.updated.setStatus(KCalendarCore::Attendee::Accepted);
         break;
     case CalendarEvent::ResponseTentative:
-        updated.setStatus(KCalendarCore::Attendee::Tentative);
+        pending.updated.setStatus(KCalendarCore::Attendee::Tentative);
         break;
     case CalendarEvent::ResponseDecline:
-        updated.setStatus(KCalendarCore::Attendee::Declined);
+        pending.updated.setStatus(KCalendarCore::Attendee::Declined);
         break;
     default:
-        updated.setStatus(KCalendarCore::Attendee::NeedsAction);
+        pending.updated.setStatus(KCalendarCore::Attendee::NeedsAction);
     }
-    updateAttendee(event, origAttendee, updated);
+    updateAttendee(event, pending.original, pending.updated);
+    m_unsavedChanges = true;
+    m_pendingResponses.append(pending);
+
+    // The sender works on copies, the result comes with responseDelivered().
+    QMetaObject::invokeMethod(m_sender, "sendResponse", Qt::QueuedConnection,
+                              Q_ARG(QString, instanceId),
+                              Q_ARG(mKCal::Notebook::Ptr, mKCal::Notebook::Ptr(new mKCal::Notebook(*notebook))),
+                              Q_ARG(KCalendarCore::Incidence::Ptr, KCalendarCore::Incidence::Ptr(event->clone())),
+                              Q_ARG(QString, event->description()));
+}
 
-    bool sent = false;
-    mKCal::Notebook::Ptr notebook = m_storage->notebook(m_calendar->notebook(event));
-    if (notebook) {
-        sent = mKCal::ServiceHandler::instance().sendResponse(notebook, event, event->description());
-        if (!sent)
-            updateAttendee(event, updated, origAttendee);
-    } else {
-        qWarning() << "Failed to load notebook for incidence" << instanceId;
+void CalendarWorker::responseDelivered(const QString &instanceId, bool sent)
+{
+    // Responses are delivered in the order they were sent.
+    if (m_pendingResponses.isEmpty() || m_pendingResponses.first().instanceId != instanceId) {
+        qWarning() << "Unexpected response result for" << instanceId;
+        return;
     }
-
-    return sent;
+    const PendingResponse pending = m_pendingResponses.takeFirst();
+    if (!sent) {
+        // Back to the previous status, unless another response replaced it.
+        applyPendingSaves();
+        KCalendarCore::Incidence::Ptr event = getInstance(instanceId);
+        if (event) {
+            const KCalendarCore::Attendee current = event->attendeeByMail(pending.updated.email());
+            if (current.status() == pending.updated.status())
+                updateAttendee(event, current, pending.original);
+        }
+    }
+    // The status stays in memory until saved, reverted or not.
+    m_unsavedChanges = true;
+    save();
+    emit responseSent(instanceId, sent);
 }
 
-QString CalendarWorker::convertEventToICalendar(const QString &instanceId, const QString &prodId) const
+QString CalendarWorker::convertEventToICalendar(const QString &instanceId, const QString &prodId)
 {
+    applyPendingSaves();
     // NOTE: exporting only the matching occurrence with instanceId,
     // for recurring parent, it will not append the exceptions,
     // for exceptions, it will not append the parent.
-    KCalendarCore::Incidence::Ptr event = m_calendar->instance(instanceId);
+    KCalendarCore::Incidence::Ptr event = getInstance(instanceId);
     if (event.isNull()) {
         qWarning() << "No event with uid " << instanceId << ", unable to create iCalendar";
         return QString();
@@ -267,13 +451,167 @@ QString CalendarWorker::convertEventToICalendar(const QString &instanceId, const
 
 void CalendarWorker::save()
 {
-    m_storage->save();
+    if (!m_openBatches.isEmpty()) {
+        m_batchSavePending = true;
+        return;
+    }
+    saveStorage();
+}
+
+bool CalendarWorker::saveStorage()
+{
+    applyPendingSaves();
+    m_saveTimer->stop();
+    m_unsavedChanges = false;
+    if (!m_storage->save())
+        return false;
+    m_unsavedSaves.clear();
+    m_unsavedDeletions.clear();
+    return true;
+}
+
+bool CalendarWorker::hasUnsavedChanges() const
+{
+    return m_unsavedChanges || !m_pendingSaves.isEmpty();
+}
+
+void CalendarWorker::saveWhenIdle()
+{
+    // The load the manager waits for goes first, the views are more
+    // urgent than the storage.
+    if (m_loadQueued.loadAcquire() && m_saveDeferrals < MaxSaveDeferrals) {
+        ++m_saveDeferrals;
+        m_saveTimer->start();
+        return;
+    }
+    m_saveDeferrals = 0;
+    save();
+}
+
+void CalendarWorker::beginBatch(int batchId)
+{
+    OpenBatch &batch = m_openBatches[batchId];
+    ++batch.depth;
+    batch.lastUse.start();
+    if (!m_batchTimer->isActive())
+        m_batchTimer->start();
+}
+
+void CalendarWorker::commitBatch(int batchId)
+{
+    QHash<int, OpenBatch>::Iterator batch = m_openBatches.find(batchId);
+    if (batch == m_openBatches.end()) {
+        qWarning() << "Batch" << batchId << "committed without being started";
+        return;
+    }
+    batch->lastUse.start();
+    if (--batch->depth > 0)
+        return;
+    m_openBatches.erase(batch);
+    if (batchId)
+        m_committedBatches.append(batchId);
+    finishBatches();
+}
+
+void CalendarWorker::abortBatch(int batchId)
+{
+    // Nobody is left to commit it, its changes go with the other batches.
+    if (m_openBatches.remove(batchId))
+        finishBatches();
+}
+
+void CalendarWorker::expireBatches()
+{
+    for (QHash<int, OpenBatch>::Iterator it = m_openBatches.begin(); it != m_openBatches.end();) {
+        if (it->lastUse.elapsed() >= BatchTimeout) {
+            qWarning() << "Batch" << it.key() << "not committed in time, saving it";
+            if (it.key())
+                m_committedBatches.append(it.key());
+            it = m_openBatches.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if (m_openBatches.isEmpty())
+        finishBatches();
+    else
+        m_batchTimer->start();
+}
+
+void CalendarWorker::finishBatches()
+{
+    if (!m_openBatches.isEmpty())
+        return;
+    m_batchTimer->stop();
+
+    // A single transaction, reported once by storageUpdated().
+    bool saved = true;
+    if (m_batchSavePending || hasUnsavedChanges()) {
+        m_batchSavePending = false;
+        saved = saveStorage();
+    }
+    const QList<int> committedBatches = m_committedBatches;
+    m_committedBatches.clear();
+    for (int id : committedBatches)
+        emit batchCommitted(id, saved);
+
+    if (!m_deferredUnloadedInstances.isEmpty()) {
+        const QStringList unloadedInstances = m_deferredUnloadedInstances;
+        m_deferredUnloadedInstances.clear();
+        unloadInstances(unloadedInstances);
+    }
 }
 
 void CalendarWorker::saveEvent(const CalendarData::Event &eventData, bool updateAttendees,
                                const QList<CalendarData::EmailContact> &required,
                                const QList<CalendarData::EmailContact> &optional)
 {
+    PendingSave pending;
+    pending.event = eventData;
+    pending.updateAttendees = updateAttendees;
+    pending.required = required;
+    pending.optional = optional;
+
+    // New events have no identifier yet, they cannot be merged.
+    if (!eventData.instanceId.isEmpty()) {
+        for (PendingSave &queued : m_pendingSaves) {
+            if (queued.event.instanceId != eventData.instanceId)
+                continue;
+            if (!updateAttendees && queued.updateAttendees) {
+                // The attendees changed earlier are still to be written.
+                pending.updateAttendees = true;
+                pending.required = queued.required;
+                pending.optional = queued.optional;
+            }
+            queued = pending;
+            m_saveTimer->start();
+            return;
+        }
+    }
+    m_pendingSaves.append(pending);
+    m_saveTimer->start();
+}
+
+void CalendarWorker::applyPendingSaves()
+{
+    if (m_pendingSaves.isEmpty())
+        return;
+
+    const QList<PendingSave> pendingSaves = m_pendingSaves;
+    m_pendingSaves.clear();
+    for (const PendingSave &pending : pendingSaves)
+        writeEvent(pending);
+    m_unsavedSaves += pendingSaves;
+    m_unsavedChanges = true;
+    m_saveTimer->start();
+}
+
+void CalendarWorker::writeEvent(const PendingSave &pending)
+{
+    const CalendarData::Event &eventData = pending.event;
+    const bool updateAttendees = pending.updateAttendees;
+    const QList<CalendarData::EmailContact> &required = pending.required;
+    const QList<CalendarData::EmailContact> &optional = pending.optional;
     QString notebookUid = eventData.calendarUid;
 
     if (!notebookUid.isEmpty() && !m_storage->isValidNotebook(notebookUid)) {
@@ -283,7 +621,7 @@ void CalendarWorker::saveEvent(const CalendarData::Event &eventData, bool update
 
     KCalendarCore::Event::Ptr event;
     if (!eventData.instanceId.isEmpty()) {
-        event = m_calendar->instance(eventData.instanceId).staticCast<KCalendarCore::Event>();
+        event = getInstance(eventData.instanceId).staticCast<KCalendarCore::Event>();
     }
     bool createNew = event.isNull();
 
@@ -350,13 +688,12 @@ void CalendarWorker::saveEvent(const CalendarData::Event &eventData, bool update
     } else if (!createNew) {
         event->endUpdates();
     }
-
-    save();
 }
 
 CalendarData::Event CalendarWorker::dissociateSingleOccurrence(const QString &instanceId, const QDateTime &datetime)
 {
-    KCalendarCore::Incidence::Ptr event = m_calendar->instance(instanceId);
+    applyPendingSaves();
+    KCalendarCore::Incidence::Ptr event = getInstance(instanceId);
     if (!event || event->hasRecurrenceId()) {
         qWarning("Event to create occurrence replacement for not found or already an exception");
         return CalendarData::Event();
@@ -379,7 +716,7 @@ CalendarData::Event CalendarWorker::dissociateSingleOccurrence(const QString &in
         qWarning("Unable to find the notebook of created exception");
         return CalendarData::Event();
     }
-    return createEventStruct(replacement.staticCast<KCalendarCore::Event>(), notebook);
+    return createEventStruct(replacement.staticCast<KCalendarCore::Event>());
 }
 
 void CalendarWorker::init()
@@ -388,8 +725,20 @@ void CalendarWorker::init()
     m_storage = m_calendar->defaultStorage(m_calendar);
     m_storage->open();
     m_storage->registerObserver(this);
+    m_calendar->registerObserver(this);
+
     loadNotebooks();
 
+    m_saveTimer = new QTimer(this);
+    m_saveTimer->setSingleShot(true);
+    m_saveTimer->setInterval(SaveDelay);
+    connect(m_saveTimer, &QTimer::timeout, this, &CalendarWorker::saveWhenIdle);
+
+    m_batchTimer = new QTimer(this);
+    m_batchTimer->setSingleShot(true);
+    m_batchTimer->setInterval(BatchTimeout);
+    connect(m_batchTimer, &QTimer::timeout, this, &CalendarWorker::expireBatches);
+
     Maemo::Timed::Interface *timed = new Maemo::Timed::Interface(this);
     if (!timed->settings_changed_connect(this, SLOT(onTimedSignal(const Maemo::Timed::WallClock::Info &, bool)))) {
         qWarning() << "Connection to timed signal failed:" << Maemo::Timed::bus().lastError().message();
@@ -502,7 +851,7 @@ void CalendarWorker::updateEventAttendees(KCalendarCore::Event::Ptr event, bool
         if (cancelAttendees.size()) {
             cancelEvent->setAttendees(cancelAttendees);
             cancelEvent->setStatus(KCalendarCore::Incidence::StatusCanceled);
-            mKCal::ServiceHandler::instance().sendUpdate(notebook, cancelEvent, QString());
+            m_sender->enqueue(notebook, cancelEvent, CalendarSender::Update);
         }
     }
 
@@ -639,57 +988,117 @@ void CalendarWorker::setNotebookColor(const QString &notebookUid, const QString
     }
 }
 
-QHash<QString, CalendarData::EventOccurrence>
-CalendarWorker::eventOccurrences(const QList<CalendarData::Range> &ranges) const
+static QDateTime rangeStart(const CalendarData::Range &range)
 {
-    QHash<QString, CalendarData::EventOccurrence> filtered;
-    for (const CalendarData::Range range : ranges) {
+    // Start one day earlier to catch the events ending in the range.
 #if (QT_VERSION >= QT_VERSION_CHECK(5, 14, 0))
-        KCalendarCore::OccurrenceIterator it(*m_calendar, range.first.addDays(-1).startOfDay(),
-                                             range.second.endOfDay());
+    return range.first.addDays(-1).startOfDay();
 #else
-        KCalendarCore::OccurrenceIterator it(*m_calendar, QDateTime(range.first.addDays(-1)),
-                                             QDateTime(range.second.addDays(1)).addSecs(-1));
+    return QDateTime(range.first.addDays(-1));
 #endif
-        while (it.hasNext()) {
-            it.next();
-            if (m_calendar->isVisible(it.incidence())
-                && it.incidence()->type() == KCalendarCore::IncidenceBase::TypeEvent
-                && m_notebooks.contains(m_calendar->notebook(it.incidence()))
-                && !m_notebooks.value(m_calendar->notebook(it.incidence())).excluded) {
-                const QDateTime sdt = it.occurrenceStartDate();
-                const KCalendarCore::Duration elapsed
-                    (it.incidence()->dateTime(KCalendarCore::Incidence::RoleDisplayStart),
-                     it.incidence()->dateTime(KCalendarCore::Incidence::RoleDisplayEnd),
-                     KCalendarCore::Duration::Seconds);
-                CalendarData::EventOccurrence occurrence;
-                occurrence.instanceId = it.incidence()->instanceIdentifier();
-                occurrence.startTime = sdt;
-                occurrence.endTime = elapsed.end(sdt);
-                occurrence.eventAllDay = it.incidence()->allDay();
-                filtered.insert(occurrence.getId(), occurrence);
-            }
+}
+
+static QDateTime rangeEnd(const CalendarData::Range &range)
+{
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 14, 0))
+    return range.second.endOfDay();
+#else
+    return QDateTime(range.second.addDays(1)).addSecs(-1);
+#endif
+}
+
+QHash<CalendarData::OccurrenceKey, CalendarData::EventOccurrence>
+CalendarWorker::eventOccurrences(const QList<CalendarData::Range> &ranges) const
+{
+    QHash<CalendarData::OccurrenceKey, CalendarData::EventOccurrence> filtered;
+    for (const CalendarData::Range range : ranges) {
+        const QDateTime start = rangeStart(range);
+        const QDateTime end = rangeEnd(range);
+        // Same selection as KCalendarCore::OccurrenceIterator over the whole calendar,
+        // exceptions are expanded together with their parent.
+        KCalendarCore::Event::List events = m_calendar->rawEvents(start.date(), end.date(), start.timeZone());
+        if (m_calendar->filter())
+            m_calendar->filter()->apply(&events);
+        KCalendarCore::Incidence::List series;
+        for (const KCalendarCore::Event::Ptr &event : events) {
+            if (!event->hasRecurrenceId())
+                series.append(event);
         }
+        addOccurrences(CalendarUtils::expandOccurrences(*m_calendar, series, start, end), &filtered);
     }
 
     return filtered;
 }
 
-QHash<QDate, QStringList>
+// Same as eventOccurrences(), restricted to the given series.
+QHash<CalendarData::OccurrenceKey, CalendarData::EventOccurrence>
+CalendarWorker::seriesOccurrences(const QList<CalendarData::Range> &ranges,
+                                  const KCalendarCore::Incidence::List &series) const
+{
+    QHash<CalendarData::OccurrenceKey, CalendarData::EventOccurrence> filtered;
+    for (const CalendarData::Range range : ranges) {
+        addOccurrences(CalendarUtils::expandOccurrences(*m_calendar, series, rangeStart(range), rangeEnd(range)),
+                       &filtered);
+    }
+
+    return filtered;
+}
+
+// Calendar visibility is cached without locking, filtering stays on this thread.
+void CalendarWorker::addOccurrences(const QList<CalendarUtils::Occurrence> &expanded,
+                                    QHash<CalendarData::OccurrenceKey, CalendarData::EventOccurrence> *occurrences) const
+{
+    // Occurrences come grouped by incidence, everything that does not
+    // depend on the occurrence is done once per incidence.
+    KCalendarCore::Incidence::Ptr previous;
+    bool visible = false;
+    CalendarData::OccurrenceKey instance;
+    QString instanceId;
+    KCalendarCore::Duration elapsed;
+    for (const CalendarUtils::Occurrence &it : expanded) {
+        const KCalendarCore::Incidence::Ptr &incidence = it.first;
+        if (incidence != previous) {
+            previous = incidence;
+            const NotebookContext &notebook = notebookContext(m_calendar->notebook(incidence));
+            visible = notebook.listed && !notebook.excluded
+                && incidence->type() == KCalendarCore::IncidenceBase::TypeEvent
+                && m_calendar->isVisible(incidence);
+            if (visible) {
+                instanceId = incidence->instanceIdentifier();
+                instance = CalendarData::OccurrenceKey(instanceId, QDateTime());
+                elapsed = KCalendarCore::Duration(incidence->dateTime(KCalendarCore::Incidence::RoleDisplayStart),
+                                                  incidence->dateTime(KCalendarCore::Incidence::RoleDisplayEnd),
+                                                  KCalendarCore::Duration::Seconds);
+            }
+        }
+        if (!visible)
+            continue;
+
+        const QDateTime &sdt = it.second;
+        CalendarData::EventOccurrence occurrence;
+        occurrence.instanceId = instanceId;
+        occurrence.startTime = sdt;
+        occurrence.endTime = elapsed.end(sdt);
+        occurrence.eventAllDay = incidence->allDay();
+        occurrences->insert(CalendarData::OccurrenceKey(instance, sdt.toMSecsSinceEpoch()), occurrence);
+    }
+}
+
+QHash<QDate, QVector<CalendarData::OccurrenceKey> >
 CalendarWorker::dailyEventOccurrences(const QList<CalendarData::Range> &ranges,
-                                      const QList<CalendarData::EventOccurrence> &occurrences) const
+                                      const QHash<CalendarData::OccurrenceKey, CalendarData::EventOccurrence> &occurrences) const
 {
-    QHash<QDate, QStringList> occurrenceHash;
-    for (const CalendarData::EventOccurrence &eo : occurrences) {
-        // On all day events the end time is inclusive, otherwise not
-        const QDate st = eo.eventAllDay ? eo.startTime.date() : eo.startTime.toLocalTime().date();
-        const QDate ed = eo.eventAllDay ? eo.endTime.date() : eo.endTime.toLocalTime().addSecs(-1).date();
+    QHash<QDate, QVector<CalendarData::OccurrenceKey> > occurrenceHash;
+    for (QHash<CalendarData::OccurrenceKey, CalendarData::EventOccurrence>::ConstIterator it = occurrences.constBegin();
+         it != occurrences.constEnd(); ++it) {
+        const QDate st = it->startDate();
+        const QDate ed = it->endDate();
 
         for (const CalendarData::Range &range: ranges) {
             const QDate s = st < range.first ? range.first : st;
             const QDate e = ed > range.second ? range.second : ed;
             for (QDate date = s; date <= e; date = date.addDays(1)) {
-                occurrenceHash[date].append(eo.getId());
+                occurrenceHash[date].append(it.key());
             }
         }
     }
@@ -700,6 +1109,10 @@ void CalendarWorker::loadData(const QList<CalendarData::Range> &ranges,
                               const QStringList &instanceList,
                               bool reset)
 {
+    m_loadQueued.storeRelease(0);
+    // What is loaded includes the changes still queued.
+    applyPendingSaves();
+    m_notebookContexts.clear();
     for (const CalendarData::Range &range : ranges) {
         m_storage->load(range.first, range.second.addDays(1)); // end date is not inclusive
     }
@@ -707,22 +1120,58 @@ void CalendarWorker::loadData(const QList<CalendarData::Range> &ranges,
     foreach (const QString &id, instanceList) {
         m_storage->loadIncidenceInstance(id);
     }
+    m_recurrenceIds.clear();
 
-    if (reset)
+    if (reset) {
         m_sentEvents.clear();
+        // Everything loaded is to be sent again, not only the new incidences.
+        const KCalendarCore::Event::List list = m_calendar->rawEvents();
+        for (const KCalendarCore::Event::Ptr &e : list)
+            m_addedInstances.insert(e->instanceIdentifier());
+        m_loadedRanges = ranges;
+    } else {
+        m_loadedRanges = CalendarUtils::addRanges(m_loadedRanges, ranges);
+    }
 
-    QHash<QString, CalendarData::Event> events;
+    QSharedPointer<CalendarData::LoadResult> result(new CalendarData::LoadResult);
+    result->ranges = ranges;
+    result->instanceList = instanceList;
+    result->events = unsentEvents(instanceList);
+    result->occurrences = eventOccurrences(ranges);
+    result->dailyOccurrences = dailyEventOccurrences(ranges, result->occurrences);
+    result->reset = reset;
+
+    emit dataLoaded(result);
+}
+
+// Returns the loaded events not passed to the manager yet. Only the ones
+// of instanceList come with their details, the views showing the others
+// fetch them when needed.
+QHash<QString, CalendarData::EventPtr> CalendarWorker::unsentEvents(const QStringList &instanceList)
+{
+    QHash<QString, CalendarData::EventPtr> events;
+    QList<EventSource> sources;
     bool orphansDeleted = false;
 
-    const KCalendarCore::Event::List list = m_calendar->rawEvents();
-    for (const KCalendarCore::Event::Ptr &e : list) {
-        if (!m_calendar->isVisible(e)) {
+    // Deleting orphans below updates m_addedInstances.
+    const QSet<QString> instances = m_addedInstances;
+    m_addedInstances.clear();
+    for (const QString &id : instances) {
+        if (m_sentEvents.contains(id)) {
+            continue;
+        }
+        const KCalendarCore::Incidence::Ptr incidence = m_calendar->instance(id);
+        if (!incidence
+            || incidence->type() != KCalendarCore::IncidenceBase::TypeEvent
+            || !m_calendar->isVisible(incidence)) {
             continue;
         }
+        const KCalendarCore::Event::Ptr e = incidence.staticCast<KCalendarCore::Event>();
         // The database may have changed after loading the events, make sure that the notebook
         // of the event still exists.
-        mKCal::Notebook::Ptr notebook = m_storage->notebook(m_calendar->notebook(e));
-        if (notebook.isNull()) {
+        EventSource source = eventSource(e);
+        source.withDetails = instanceList.contains(id);
+        if (!source.notebook.exists) {
             // This may be a symptom of a deeper bug: if a sync adapter (or mkcal)
             // doesn't delete events which belong to a deleted notebook, then the
             // events will be "orphan" and need to be deleted.
@@ -742,37 +1191,212 @@ void CalendarWorker::loadData(const QList<CalendarData::Range> &ranges,
             continue;
         }
 
-        const QString id = e->instanceIdentifier();
-        if (!m_sentEvents.contains(id)) {
-            CalendarData::Event event = createEventStruct(e, notebook);
-            m_sentEvents.insert(id);
-            events.insert(id, event);
-        }
+        sources.append(source);
+        m_sentEvents.insert(id);
     }
 
+    const QList<CalendarData::EventPtr> converted = createEventStructs(sources);
+    for (const CalendarData::EventPtr &event : converted)
+        events.insert(event->instanceId, event);
+
     if (orphansDeleted) {
         save(); // save the orphan deletions to storage.
     }
 
-    QHash<QString, CalendarData::EventOccurrence> occurrences = eventOccurrences(ranges);
-    QHash<QDate, QStringList> dailyOccurrences = dailyEventOccurrences(ranges, occurrences.values());
 
-    emit dataLoaded(ranges, instanceList, events, occurrences, dailyOccurrences, reset);
+    return events;
+}
+
+int CalendarWorker::prefetchGeneration() const
+{
+    return m_prefetchGeneration.loadAcquire();
+}
+
+void CalendarWorker::cancelPrefetch()
+{
+    m_prefetchGeneration.fetchAndAddOrdered(1);
+}
+
+CalendarData::OutboundStatistics CalendarWorker::outboundStatistics() const
+{
+    return m_sender->statistics();
+}
+
+void CalendarWorker::notifyLoadQueued()
+{
+    m_loadQueued.storeRelease(1);
+}
+
+bool CalendarWorker::isPrefetchCancelled(int generation) const
+{
+    return generation != m_prefetchGeneration.loadAcquire();
+}
+
+// Same as loadData() for a range nobody is waiting for. The request is
+// dropped as soon as the manager needs the worker for something else,
+// checked between the expensive steps.
+void CalendarWorker::prefetchData(const CalendarData::Range &range, int generation)
+{
+    if (isPrefetchCancelled(generation))
+        return;
+
+    applyPendingSaves();
+    m_notebookContexts.clear();
+    m_storage->load(range.first, range.second.addDays(1)); // end date is not inclusive
+    m_recurrenceIds.clear();
+    if (isPrefetchCancelled(generation))
+        return;
+
+    QSharedPointer<CalendarData::LoadResult> result(new CalendarData::LoadResult);
+    result->ranges << range;
+    result->occurrences = eventOccurrences(result->ranges);
+    if (isPrefetchCancelled(generation))
+        return;
+
+    result->dailyOccurrences = dailyEventOccurrences(result->ranges, result->occurrences);
+    m_loadedRanges = CalendarUtils::addRanges(m_loadedRanges, result->ranges);
+    result->events = unsentEvents();
+
+    emit dataPrefetched(result);
+}
+
+// Whether the incidence may show in one of the ranges, loads cover the
+// day before and after a range. Recurring incidences are checked over
+// the whole recurrence, erring on the side of keeping them.
+static bool mayOccurIn(const KCalendarCore::Incidence::Ptr &incidence,
+                       const QList<CalendarData::Range> &ranges)
+{
+    const QDate start = incidence->dtStart().toLocalTime().date();
+    QDate end;
+    if (incidence->recurs()) {
+        if (incidence->recurrence()->duration() != -1)
+            end = incidence->recurrence()->endDate();
+    } else {
+        end = incidence->dateTime(KCalendarCore::Incidence::RoleDisplayEnd).toLocalTime().date();
+    }
+    for (const CalendarData::Range &range : ranges) {
+        if (start <= range.second.addDays(1) && (!end.isValid() || end >= range.first.addDays(-1)))
+            return true;
+    }
+    return false;
+}
+
+// The manager dropped the ranges and the instances not used anymore.
+// The other incidences stay in memory, including the ones loaded by
+// requests queued before this one.
+void CalendarWorker::unloadData(const QList<CalendarData::Range> &evictedRanges,
+                                const QStringList &unloadedInstances)
+{
+    for (const CalendarData::Range &range : evictedRanges)
+        m_loadedRanges = CalendarUtils::removeRange(m_loadedRanges, range);
+
+    if (!m_openBatches.isEmpty()) {
+        // The batch changes are not saved before the commit, keep them.
+        m_deferredUnloadedInstances += unloadedInstances;
+        return;
+    }
+    unloadInstances(unloadedInstances);
+}
+
+void CalendarWorker::unloadInstances(const QStringList &instanceIds)
+{
+    // Dropped incidences lose the changes not saved yet.
+    if (hasUnsavedChanges())
+        save();
+
+    KCalendarCore::Incidence::List resent;
+    bool removed = false;
+    // Removed from memory only, the storage must not record a deletion.
+    m_calendar->unregisterObserver(m_storage.data());
+    for (const QString &id : instanceIds) {
+        // The manager does not have the event anymore.
+        m_sentEvents.remove(id);
+        const KCalendarCore::Incidence::Ptr incidence = m_calendar->instance(id);
+        if (!incidence)
+            continue;
+        if (mayOccurIn(incidence, m_loadedRanges)) {
+            // Loaded again meanwhile, the manager gets it back.
+            resent.append(incidence);
+            continue;
+        }
+        if (incidence->recurs() && !m_calendar->instances(incidence).isEmpty()) {
+            // Exceptions still in use need their parent.
+            bool orphaned = true;
+            for (const KCalendarCore::Incidence::Ptr &exception : m_calendar->instances(incidence))
+                orphaned &= instanceIds.contains(exception->instanceIdentifier());
+            if (!orphaned)
+                continue;
+        }
+        m_calendar->deleteIncidence(incidence);
+        removed = true;
+    }
+    m_calendar->registerObserver(m_storage.data());
+
+    if (removed) {
+        // Ranges of the dropped incidences are read again when requested.
+        m_storage->clearLoaded();
+        m_recurrenceIds.clear();
+    }
+    if (!resent.isEmpty())
+        sendSeriesUpdate(KCalendarCore::Incidence::List(), resent, KCalendarCore::Incidence::List());
+}
+
+const CalendarWorker::NotebookContext &CalendarWorker::notebookContext(const QString &notebookUid) const
+{
+    QHash<QString, NotebookContext>::ConstIterator it = m_notebookContexts.constFind(notebookUid);
+    if (it != m_notebookContexts.constEnd())
+        return *it;
+
+    NotebookContext context;
+    context.uid = notebookUid;
+    const mKCal::Notebook::Ptr notebook = m_storage->notebook(notebookUid);
+    if (notebook) {
+        context.exists = true;
+        context.readOnly = notebook->isReadOnly();
+        context.sharedWith = notebook->sharedWith();
+    }
+    const QHash<QString, CalendarData::Notebook>::ConstIterator listed = m_notebooks.constFind(notebookUid);
+    if (listed != m_notebooks.constEnd()) {
+        context.listed = true;
+        context.excluded = listed->excluded;
+        context.ownerEmail = listed->emailAddress;
+    }
+    return *m_notebookContexts.insert(notebookUid, context);
+}
+
+CalendarData::Event CalendarWorker::createEventStruct(const KCalendarCore::Event::Ptr &e) const
+{
+    return createEventStruct(eventSource(e));
 }
 
-CalendarData::Event CalendarWorker::createEventStruct(const KCalendarCore::Event::Ptr &e,
-                                                      mKCal::Notebook::Ptr notebook) const
+CalendarWorker::EventSource CalendarWorker::eventSource(const KCalendarCore::Event::Ptr &e) const
 {
+    EventSource source;
+    source.event = e;
+    source.notebook = notebookContext(m_calendar->notebook(e));
+    return source;
+}
+
+// Only reads the event, can run on any thread as long as
+// each event is converted on a single one.
+CalendarData::Event CalendarWorker::createEventStruct(const EventSource &source)
+{
+    const KCalendarCore::Event::Ptr &e = source.event;
     CalendarData::Event event(*e);
-    event.calendarUid = m_calendar->notebook(e);
-    event.readOnly = m_storage->notebook(event.calendarUid)->isReadOnly();
+    if (!source.withDetails) {
+        event.description.clear();
+        event.location.clear();
+        event.detailsLoaded = false;
+    }
+    event.calendarUid = source.notebook.uid;
+    event.readOnly = source.notebook.readOnly;
     bool externalInvitation = false;
-    const QString &calendarOwnerEmail = getNotebookAddress(event.calendarUid);
+    const QString &calendarOwnerEmail = source.notebook.ownerEmail;
 
     KCalendarCore::Person organizer = e->organizer();
     const QString organizerEmail = organizer.email();
     if (!organizerEmail.isEmpty() && organizerEmail != calendarOwnerEmail
-            && (notebook.isNull() || !notebook->sharedWith().contains(organizerEmail))) {
+            && !source.notebook.sharedWith.contains(organizerEmail)) {
         externalInvitation = true;
     }
     event.externalInvitation = externalInvitation;
@@ -797,14 +1421,43 @@ CalendarData::Event CalendarWorker::createEventStruct(const KCalendarCore::Event
             event.rsvp = calAttendee.RSVP();// || calAttendee->role() != KCalendarCore::Attendee::Chair;
         }
     }
+    // Lets the event objects tell what changed from a previous record
+    // without comparing the properties themselves.
+    event.updateHashes();
     return event;
 }
 
+// Same order as the sources, the conversion is spread over the
+// global thread pool when there are enough events.
+QList<CalendarData::EventPtr> CalendarWorker::createEventStructs(const QList<EventSource> &sources)
+{
+    const EventConverter convert;
+    if (sources.count() < ParallelConversionThreshold)
+        return convert(sources);
+
+    const int chunkCount = qMax(1, QThread::idealThreadCount()) * 4;
+    const int chunkSize = (sources.count() + chunkCount - 1) / chunkCount;
+    QList<QList<EventSource> > chunks;
+    for (int i = 0; i < sources.count(); i += chunkSize)
+        chunks.append(sources.mid(i, chunkSize));
+
+    const QList<QList<CalendarData::EventPtr> > results = QtConcurrent::blockingMapped(chunks, convert);
+    QList<CalendarData::EventPtr> events;
+    events.reserve(sources.count());
+    for (const QList<CalendarData::EventPtr> &result : results)
+        events.append(result);
+    return events;
+}
+
 void CalendarWorker::search(const QString &searchString, int limit)
 {
     QStringList identifiers;
-    QHash<QString, CalendarData::Event> events;
+    QHash<QString, CalendarData::EventPtr> events;
 
+    // The search runs on the database.
+    if (hasUnsavedChanges())
+        save();
+    m_notebookContexts.clear();
     if (m_storage->search(searchString, &identifiers, limit)) {
         emit searchResults(searchString, identifiers);
     }
@@ -815,17 +1468,17 @@ void CalendarWorker::search(const QString &searchString, int limit)
             if (incidence
                 && incidence->type() == KCalendarCore::IncidenceBase::TypeEvent
                 && m_calendar->isVisible(incidence)) {
-                mKCal::Notebook::Ptr notebook = m_storage->notebook(m_calendar->notebook(incidence));
-                CalendarData::Event event = createEventStruct(incidence.staticCast<KCalendarCore::Event>(), notebook);
+                CalendarData::EventPtr event(new CalendarData::Event(createEventStruct(incidence.staticCast<KCalendarCore::Event>())));
                 m_sentEvents.insert(identifiers[i]);
                 events.insert(identifiers[i], event);
             }
         }
     }
     if (!events.isEmpty()) {
-        emit dataLoaded(QList<CalendarData::Range>(), identifiers, events,
-                        QHash<QString, CalendarData::EventOccurrence>(),
-                        QHash<QDate, QStringList>(), false);
+        QSharedPointer<CalendarData::LoadResult> result(new CalendarData::LoadResult);
+        result->instanceList = identifiers;
+        result->events = events;
+        emit dataLoaded(result);
     }
 }
 
@@ -856,7 +1509,15 @@ void CalendarWorker::loadNotebooks()
     QStringList defaultNotebookColors = QStringList() << "#00aeef" << "red" << "blue" << "green" << "pink" << "yellow";
     int nextDefaultNotebookColor = 0;
 
+    m_notebookContexts.clear();
     const mKCal::Notebook::List notebooks = m_storage->notebooks();
+    // The addresses come from the service plugins, on the sender thread.
+    // The known ones are used until the lookup completes.
+    mKCal::Notebook::List lookedUp;
+    for (const mKCal::Notebook::Ptr &notebook : notebooks)
+        lookedUp.append(mKCal::Notebook::Ptr(new mKCal::Notebook(*notebook)));
+    QMetaObject::invokeMethod(m_sender, "lookupEmailAddresses", Qt::QueuedConnection,
+                              Q_ARG(mKCal::Notebook::List, lookedUp));
     QSettings settings("nemo", "nemo-qml-plugin-calendar");
 
     QHash<QString, CalendarData::Notebook> newNotebooks;
@@ -873,7 +1534,7 @@ void CalendarWorker::loadNotebooks()
         notebook.name = mkNotebook->name();
         notebook.uid = mkNotebook->uid();
         notebook.description = mkNotebook->description();
-        notebook.emailAddress = mKCal::ServiceHandler::instance().emailAddress(mkNotebook);
+        notebook.emailAddress = m_emailAddresses.value(mkNotebook->uid());
         notebook.isDefault = m_storage->defaultNotebook()
                 && (mkNotebook->uid() == m_storage->defaultNotebook()->uid());
         notebook.readOnly = mkNotebook->isReadOnly();
@@ -943,23 +1604,68 @@ void CalendarWorker::loadNotebooks()
     }
 }
 
+void CalendarWorker::emailAddressesFound(const QHash<QString, QString> &addresses)
+{
+    m_emailAddresses = addresses;
+
+    bool changed = false;
+    for (QHash<QString, CalendarData::Notebook>::Iterator it = m_notebooks.begin();
+         it != m_notebooks.end(); ++it) {
+        const QString address = addresses.value(it.key());
+        if (it->emailAddress != address) {
+            it->emailAddress = address;
+            changed = true;
+        }
+    }
+    if (changed)
+        emit notebooksChanged(m_notebooks.values());
+}
+
 
 CalendarData::EventOccurrence CalendarWorker::getNextOccurrence(const QString &instanceId,
-                                                                const QDateTime &start) const
+                                                                const QDateTime &start)
 {
+    applyPendingSaves();
     KCalendarCore::Event::Ptr event = getInstance(instanceId).staticCast<KCalendarCore::Event>();
     if (!event) {
         qWarning() << "Failed to get next occurrence, event not found. UID = " << instanceId;
         return CalendarData::EventOccurrence();
     }
-    return CalendarUtils::getNextOccurrence(event, start, event->recurs() ? m_calendar->instances(event) : KCalendarCore::Incidence::List());
+    if (!event->recurs())
+        return CalendarUtils::getNextOccurrence(event, start);
+    return CalendarUtils::getNextOccurrence(event, start, recurrenceIds(event));
+}
+
+const QVector<QDateTime> &CalendarWorker::recurrenceIds(const KCalendarCore::Incidence::Ptr &series) const
+{
+    QHash<QString, QVector<QDateTime> >::Iterator it = m_recurrenceIds.find(series->uid());
+    if (it == m_recurrenceIds.end()) {
+        const KCalendarCore::Incidence::List exceptions = m_calendar->instances(series);
+        QVector<QDateTime> ids;
+        ids.reserve(exceptions.count());
+        for (const KCalendarCore::Incidence::Ptr &exception : exceptions)
+            ids.append(exception->recurrenceId());
+        std::sort(ids.begin(), ids.end());
+        it = m_recurrenceIds.insert(series->uid(), ids);
+    }
+    return *it;
+}
+
+void CalendarWorker::getNextOccurrences(const QStringList &instanceIds, const QDateTime &startTime)
+{
+    QHash<QString, CalendarData::EventOccurrence> occurrences;
+    for (const QString &instanceId : instanceIds) {
+        occurrences.insert(instanceId, getNextOccurrence(instanceId, startTime));
+    }
+    emit nextOccurrencesFound(startTime, occurrences);
 }
 
 QList<CalendarData::Attendee> CalendarWorker::getEventAttendees(const QString &instanceId)
 {
+    applyPendingSaves();
     QList<CalendarData::Attendee> result;
 
-    KCalendarCore::Incidence::Ptr event = m_calendar->instance(instanceId);
+    KCalendarCore::Incidence::Ptr event = getInstance(instanceId);
 
     if (event.isNull()) {
         return result;
@@ -968,8 +1674,33 @@ QList<CalendarData::Attendee> CalendarWorker::getEventAttendees(const QString &i
     return CalendarUtils::getEventAttendees(event);
 }
 
+CalendarData::Event CalendarWorker::getEventDetails(const QString &instanceId)
+{
+    applyPendingSaves();
+    const KCalendarCore::Incidence::Ptr incidence = getInstance(instanceId);
+    if (!incidence || incidence->type() != KCalendarCore::IncidenceBase::TypeEvent) {
+        return CalendarData::Event();
+    }
+
+    return createEventStruct(incidence.staticCast<KCalendarCore::Event>());
+}
+
+void CalendarWorker::loadEventDetails(const QStringList &instanceIds)
+{
+    QHash<QString, CalendarData::Event> events;
+    for (const QString &id : instanceIds) {
+        const CalendarData::Event event = getEventDetails(id);
+        if (event.isValid()) {
+            events.insert(id, event);
+        }
+    }
+
+    emit eventDetailsLoaded(instanceIds, events);
+}
+
 void CalendarWorker::findMatchingEvent(const QString &invitationFile)
 {
+    applyPendingSaves();
     KCalendarCore::MemoryCalendar::Ptr cal(new KCalendarCore::MemoryCalendar(QTimeZone::systemTimeZone()));
     CalendarUtils::importFromFile(invitationFile, cal);
     KCalendarCore::Incidence::List incidenceList = cal->incidences();
@@ -34,9 +34,16 @@
 #define CALENDARWORKER_H
 
 #include "calendardata.h"
+#include "calendarutils.h"
 
 #include <QObject>
 #include <QHash>
+#include <QAtomicInt>
+#include <QThread>
+#include <QElapsedTimer>
+
+class QTimer;
+class CalendarSender;
 
 // mkcal
 #include <extendedstorage.h>
@@ -49,7 +56,8 @@ namespace Accounts { class Manager; }
 
 class CalendarInvitationQuery;
 
-class CalendarWorker : public QObject, public mKCal::ExtendedStorageObserver
+class CalendarWorker : public QObject, public mKCal::ExtendedStorageObserver,
+                       public KCalendarCore::Calendar::CalendarObserver
 {
     Q_OBJECT
     
@@ -64,18 +72,65 @@ public:
                         const KCalendarCore::Incidence::List &modified,
                         const KCalendarCore::Incidence::List &deleted);
 
+    /* KCalendarCore::Calendar::CalendarObserver */
+    void calendarIncidenceAdded(const KCalendarCore::Incidence::Ptr &incidence);
+    void calendarIncidenceDeleted(const KCalendarCore::Incidence::Ptr &incidence,
+                                  const KCalendarCore::Calendar *calendar);
+
+    // Notebook details used when converting and expanding events,
+    // looked up once per load instead of once per event.
+    struct NotebookContext {
+        QString uid;
+        bool exists = false; // in the storage
+        bool listed = false; // in notebooks(), with events allowed and an enabled account
+        bool excluded = false;
+        bool readOnly = false;
+        QString ownerEmail;
+        QStringList sharedWith;
+    };
+    // What createEventStruct() needs to know about an event, gathered
+    // on the worker thread as the storage is not thread safe.
+    struct EventSource {
+        KCalendarCore::Event::Ptr event;
+        NotebookContext notebook;
+        bool withDetails = true; // description and location
+    };
+    static CalendarData::Event createEventStruct(const EventSource &source);
+    static QList<CalendarData::EventPtr> createEventStructs(const QList<EventSource> &sources);
+
+    // Thread safe, callable from the manager thread.
+    int prefetchGeneration() const;
+    void cancelPrefetch();
+    // Thread safe
+    CalendarData::OutboundStatistics outboundStatistics() const;
+    // Thread safe, tells that loadData() is on its way. Queued saves are
+    // held back until it started.
+    void notifyLoadQueued();
+
 public slots:
     void init();
+    // Also writes the modifications waiting in the write-behind queue.
     void save();
+    // Saves requested between these are done at once, when the last open
+    // batch is committed. Batches are nested by id, non zero ids are
+    // reported by batchCommitted() once saved. Batches left without
+    // activity for too long are given up and saved.
+    void beginBatch(int batchId);
+    void commitBatch(int batchId);
+    // Closes the batch whatever its depth, without reporting it.
+    void abortBatch(int batchId);
 
+    // Queued, successive saves of the same instance are merged and
+    // written together after a short idle time.
     void saveEvent(const CalendarData::Event &eventData, bool updateAttendees,
                    const QList<CalendarData::EmailContact> &required,
                    const QList<CalendarData::EmailContact> &optional);
     CalendarData::Event dissociateSingleOccurrence(const QString &instanceId, const QDateTime &datetime);
     void deleteEvent(const QString &instanceId, const QDateTime &dateTime);
     void deleteAll(const QString &instanceId);
-    bool sendResponse(const QString &instanceId, const CalendarEvent::Response response);
-    QString convertEventToICalendar(const QString &instanceId, const QString &prodId) const;
+    // The result comes with responseSent(), the status is saved then.
+    void sendResponse(const QString &instanceId, const CalendarEvent::Response response);
+    QString convertEventToICalendar(const QString &instanceId, const QString &prodId);
 
     QList<CalendarData::Notebook> notebooks() const;
     void setNotebookColor(const QString &notebookUid, const QString &color);
@@ -85,18 +140,24 @@ public slots:
 
     void loadData(const QList<CalendarData::Range> &ranges,
                   const QStringList &instanceList, bool reset);
+    void unloadData(const QList<CalendarData::Range> &evictedRanges,
+                    const QStringList &unloadedInstances);
+    void prefetchData(const CalendarData::Range &range, int generation);
 
     void search(const QString &searchString, int limit);
 
     CalendarData::EventOccurrence getNextOccurrence(const QString &instanceId,
-                                                    const QDateTime &startTime) const;
+                                                    const QDateTime &startTime);
+    void getNextOccurrences(const QStringList &instanceIds, const QDateTime &startTime);
     QList<CalendarData::Attendee> getEventAttendees(const QString &instanceId);
+    void loadEventDetails(const QStringList &instanceIds);
 
     void findMatchingEvent(const QString &invitationFile);
     void onTimedSignal(const Maemo::Timed::WallClock::Info &info, bool time_changed);
 
 signals:
     void storageModifiedSignal();
+    void batchCommitted(int batchId, bool saved);
     void calendarTimezoneChanged();
 
     void eventNotebookChanged(const QString &oldInstanceId, const QString &newInstanceId, const QString &notebookUid);
@@ -105,19 +166,60 @@ signals:
     void notebookColorChanged(const CalendarData::Notebook &notebook);
     void notebooksChanged(const QList<CalendarData::Notebook> &notebooks);
 
-    void dataLoaded(const QList<CalendarData::Range> &ranges,
-                    const QStringList &instanceList,
-                    const QHash<QString, CalendarData::Event> &events,
-                    const QHash<QString, CalendarData::EventOccurrence> &occurrences,
-                    const QHash<QDate, QStringList> &dailyOccurrences,
-                    bool reset);
+    void dataLoaded(const CalendarData::LoadResultPtr &result);
+    void dataPrefetched(const CalendarData::LoadResultPtr &result);
+    // Replaces everything known about the given incidence series.
+    void dataPatched(const QStringList &seriesUids,
+                     const QHash<QString, CalendarData::EventPtr> &events,
+                     const QHash<CalendarData::OccurrenceKey, CalendarData::EventOccurrence> &occurrences,
+                     const QHash<QDate, QVector<CalendarData::OccurrenceKey> > &dailyOccurrences);
+
+    void eventDetailsLoaded(const QStringList &instanceIds,
+                            const QHash<QString, CalendarData::Event> &events);
+
+    void nextOccurrencesFound(const QDateTime &startTime,
+                              const QHash<QString, CalendarData::EventOccurrence> &occurrences);
 
     void searchResults(const QString &searchString, const QStringList &identifiers);
 
     void findMatchingEventFinished(const QString &invitationFile,
                                    const CalendarData::Event &eventData);
 
+    void responseSent(const QString &instanceId, bool sent);
+
 private:
+    friend class tst_CalendarManager;
+
+    struct PendingSave {
+        CalendarData::Event event;
+        bool updateAttendees;
+        QList<CalendarData::EmailContact> required;
+        QList<CalendarData::EmailContact> optional;
+    };
+    struct PendingResponse {
+        QString instanceId;
+        KCalendarCore::Attendee original;
+        KCalendarCore::Attendee updated;
+    };
+    struct PendingDeletion {
+        QString instanceId;
+        QDateTime dateTime;
+        bool all;
+    };
+
+    void writeEvent(const PendingSave &pending);
+    void saveWhenIdle();
+    CalendarData::Event getEventDetails(const QString &instanceId);
+    void responseDelivered(const QString &instanceId, bool sent);
+    void emailAddressesFound(const QHash<QString, QString> &addresses);
+    void expireBatches();
+    void finishBatches();
+    // Brings the queued modifications to m_calendar, before reading it.
+    // They are saved to storage once the idle time is over.
+    void applyPendingSaves();
+    bool hasUnsavedChanges() const;
+    bool saveStorage();
+
     void loadNotebooks();
     QStringList excludedNotebooks() const;
     bool saveExcludeNotebook(const QString &notebookUid, bool exclude);
@@ -130,11 +232,25 @@ private:
     QString getNotebookAddress(const QString &notebookUid) const;
     KCalendarCore::Incidence::Ptr getInstance(const QString &instanceId) const;
 
-    CalendarData::Event createEventStruct(const KCalendarCore::Event::Ptr &event,
-                                          mKCal::Notebook::Ptr notebook = mKCal::Notebook::Ptr()) const;
-    QHash<QString, CalendarData::EventOccurrence> eventOccurrences(const QList<CalendarData::Range> &ranges) const;
-    QHash<QDate, QStringList> dailyEventOccurrences(const QList<CalendarData::Range> &ranges,
-                                                    const QList<CalendarData::EventOccurrence> &occurrences) const;
+    const NotebookContext &notebookContext(const QString &notebookUid) const;
+    CalendarData::Event createEventStruct(const KCalendarCore::Event::Ptr &event) const;
+    EventSource eventSource(const KCalendarCore::Event::Ptr &event) const;
+    QHash<QString, CalendarData::EventPtr> unsentEvents(const QStringList &instanceList = QStringList());
+    bool isPrefetchCancelled(int generation) const;
+    QHash<CalendarData::OccurrenceKey, CalendarData::EventOccurrence>
+    eventOccurrences(const QList<CalendarData::Range> &ranges) const;
+    QHash<CalendarData::OccurrenceKey, CalendarData::EventOccurrence>
+    seriesOccurrences(const QList<CalendarData::Range> &ranges, const KCalendarCore::Incidence::List &series) const;
+    void addOccurrences(const QList<CalendarUtils::Occurrence> &expanded,
+                        QHash<CalendarData::OccurrenceKey, CalendarData::EventOccurrence> *occurrences) const;
+    void sendSeriesUpdate(const KCalendarCore::Incidence::List &added,
+                          const KCalendarCore::Incidence::List &modified,
+                          const KCalendarCore::Incidence::List &deleted);
+    void unloadInstances(const QStringList &instanceIds);
+    const QVector<QDateTime> &recurrenceIds(const KCalendarCore::Incidence::Ptr &series) const;
+    QHash<QDate, QVector<CalendarData::OccurrenceKey> >
+    dailyEventOccurrences(const QList<CalendarData::Range> &ranges,
+                          const QHash<CalendarData::OccurrenceKey, CalendarData::EventOccurrence> &occurrences) const;
 
     Accounts::Manager *m_accountManager;
 
@@ -142,9 +258,58 @@ private:
     mKCal::ExtendedStorage::Ptr m_storage;
 
     QHash<QString, CalendarData::Notebook> m_notebooks;
+    // Cleared on each load and notebook change, filled on demand.
+    mutable QHash<QString, NotebookContext> m_notebookContexts;
 
     // Tracks which events have been already passed to manager, using instanceIdentifiers.
     QSet<QString> m_sentEvents;
+    // Instances added to m_calendar since the last unsentEvents(),
+    // the only ones that may not have been passed to manager yet.
+    QSet<QString> m_addedInstances;
+
+    // Ranges passed to manager, non-overlapping and sorted by start date.
+    QList<CalendarData::Range> m_loadedRanges;
+
+    // Sorted recurrence ids of the exceptions, by series uid. Invalidated
+    // on any change or load, since a load may bring new exceptions.
+    mutable QHash<QString, QVector<QDateTime> > m_recurrenceIds;
+
+    // Bumped to drop the queued prefetch requests.
+    QAtomicInt m_prefetchGeneration;
+
+    // Nesting of the open batches by id, and whether a save waits for
+    // their commit.
+    struct OpenBatch {
+        int depth = 0;
+        QElapsedTimer lastUse;
+    };
+    QHash<int, OpenBatch> m_openBatches;
+    bool m_batchSavePending;
+    QList<int> m_committedBatches;
+    QTimer *m_batchTimer;
+    // Instances unloaded during a batch, dropped after the commit since
+    // the batch changes are only in m_calendar until then.
+    QStringList m_deferredUnloadedInstances;
+
+    // Write-behind queue, in saving order with one entry per instance.
+    QList<PendingSave> m_pendingSaves;
+    // Changes in m_calendar not saved to storage yet.
+    bool m_unsavedChanges;
+    // The same changes, written again if an external modification of
+    // the storage wipes m_calendar before they are saved.
+    QList<PendingSave> m_unsavedSaves;
+    QList<PendingDeletion> m_unsavedDeletions;
+    QTimer *m_saveTimer;
+    int m_saveDeferrals;
+    QAtomicInt m_loadQueued;
+
+    // Invitations and updates go out from their own thread.
+    QThread m_senderThread;
+    CalendarSender *m_sender;
+    // Responses waiting for the sender, in sending order.
+    QList<PendingResponse> m_pendingResponses;
+    // Notebook addresses found by the sender, by notebook uid.
+    QHash<QString, QString> m_emailAddresses;
 };
 
 #endif // CALENDARWORKER_H
@@ -30,13 +30,16 @@ SOURCES += \
     $$SRCDIR/calendareventoccurrence.cpp \
     $$SRCDIR/calendaragendamodel.cpp \
     $$SRCDIR/calendareventlistmodel.cpp \
+    $$SRCDIR/calendarmonthsummarymodel.cpp \
     $$SRCDIR/calendarsearchmodel.cpp \
     $$SRCDIR/calendarapi.cpp \
     $$SRCDIR/calendareventquery.cpp \
     $$SRCDIR/calendarinvitationquery.cpp \
     $$SRCDIR/calendarnotebookmodel.cpp \
     $$SRCDIR/calendarmanager.cpp \
+    $$SRCDIR/calendaroccurrenceindex.cpp \
     $$SRCDIR/calendarworker.cpp \
+    $$SRCDIR/calendarsender.cpp \
     $$SRCDIR/calendarnotebookquery.cpp \
     $$SRCDIR/calendareventmodification.cpp \
     $$SRCDIR/calendarutils.cpp \
@@ -50,13 +53,16 @@ HEADERS += \
     $$SRCDIR/calendareventoccurrence.h \
     $$SRCDIR/calendaragendamodel.h \
     $$SRCDIR/calendareventlistmodel.h \
+    $$SRCDIR/calendarmonthsummarymodel.h \
     $$SRCDIR/calendarsearchmodel.h \
     $$SRCDIR/calendarapi.h \
     $$SRCDIR/calendareventquery.h \
     $$SRCDIR/calendarinvitationquery.h \
     $$SRCDIR/calendarnotebookmodel.h \
     $$SRCDIR/calendarmanager.h \
+    $$SRCDIR/calendaroccurrenceindex.h \
     $$SRCDIR/calendarworker.h \
+    $$SRCDIR/calendarsender.h \
     $$SRCDIR/calendardata.h \
     $$SRCDIR/calendarnotebookquery.h \
     $$SRCDIR/calendareventmodification.h \
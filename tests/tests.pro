@@ -4,7 +4,9 @@ SUBDIRS = \
     tst_calendarevent \
     tst_calendaragendamodel \
     tst_calendarimportmodel \
-    tst_calendarsearchmodel
+    tst_calendarsearchmodel \
+    tst_calendarmonthsummarymodel \
+    tst_calendarsender
 
 tests_xml.path = /opt/tests/nemo-qml-plugin-calendar-qt5
 tests_xml.files = tests.xml
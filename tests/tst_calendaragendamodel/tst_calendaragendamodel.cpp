@@ -29,6 +29,7 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
  */
 #include <QObject>
+#include <QPointer>
 #include <QSignalSpy>
 #include <QtTest>
 
@@ -48,6 +49,8 @@ private slots:
     void testStartEndDate();
     void testTimeZone();
     void testAllDays();
+    void testOccurrenceObjects();
+    void testFilterMode();
 };
 
 void tst_CalendarAgendaModel::initTestCase()
@@ -56,7 +59,7 @@ void tst_CalendarAgendaModel::initTestCase()
     QSignalSpy *ready = new QSignalSpy(manager, &CalendarManager::notebooksChanged);
     QVERIFY(ready->wait());
     
-    QSignalSpy *modified = new QSignalSpy(manager, &CalendarManager::storageModified);
+    QSignalSpy *modified = new QSignalSpy(manager, &CalendarManager::dataUpdated);
     CalendarEventModification *event1 = new CalendarEventModification;
     event1->setDescription(QString::fromLatin1("event 1"));
     event1->setStartTime(QDateTime(QDate(2021, 11, 18), QTime(13, 29)),
@@ -190,5 +193,78 @@ void tst_CalendarAgendaModel::testAllDays()
     delete model;
 }
 
+void tst_CalendarAgendaModel::testOccurrenceObjects()
+{
+    CalendarAgendaModel *model = new CalendarAgendaModel;
+
+    QSignalSpy *updated = new QSignalSpy(model, &CalendarAgendaModel::updated);
+    model->setStartDate(QDate(2021, 11, 18));
+    model->setEndDate(QDate(2021, 11, 19));
+    QVERIFY(updated->wait());
+    QCOMPARE(model->count(), 2);
+    CalendarEventOccurrence *occurrence1 = model->get(0, CalendarAgendaModel::OccurrenceObjectRole).value<CalendarEventOccurrence*>();
+    QVERIFY(occurrence1);
+    QCOMPARE(model->findChildren<CalendarEventOccurrence*>().count(), 1);
+
+    // Same rows, the occurrence object is kept
+    QSignalSpy *rowsInserted = new QSignalSpy(model, &CalendarAgendaModel::rowsInserted);
+    model->setEndDate(QDate(2021, 11, 20));
+    QVERIFY(updated->wait());
+    QCOMPARE(model->count(), 2);
+    QCOMPARE(rowsInserted->count(), 0);
+    QCOMPARE(model->get(0, CalendarAgendaModel::OccurrenceObjectRole).value<CalendarEventOccurrence*>(), occurrence1);
+    QCOMPARE(model->findChildren<CalendarEventOccurrence*>().count(), 1);
+
+    // Objects of removed rows are deleted, not handed to other rows.
+    QPointer<CalendarEventOccurrence> removed(occurrence1);
+    model->setStartDate(QDate(2021, 11, 19));
+    QVERIFY(updated->wait());
+    QCOMPARE(model->count(), 1);
+    QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+    QVERIFY(removed.isNull());
+    QCOMPARE(model->findChildren<CalendarEventOccurrence*>().count(), 0);
+    CalendarEventOccurrence *occurrence2 = model->get(0, CalendarAgendaModel::OccurrenceObjectRole).value<CalendarEventOccurrence*>();
+    QVERIFY(occurrence2);
+    QCOMPARE(occurrence2->eventObject()->description(), QString::fromLatin1("event 2"));
+    QCOMPARE(model->findChildren<CalendarEventOccurrence*>().count(), 1);
+
+    delete rowsInserted;
+    delete updated;
+    delete model;
+}
+
+void tst_CalendarAgendaModel::testFilterMode()
+{
+    CalendarAgendaModel *model = new CalendarAgendaModel;
+
+    QSignalSpy *updated = new QSignalSpy(model, &CalendarAgendaModel::updated);
+    model->setStartDate(QDate(2021, 10, 9));
+    model->setEndDate(QDate(2021, 11, 20));
+    QVERIFY(updated->wait());
+    QCOMPARE(model->count(), 6);
+
+    model->setFilterMode(CalendarAgendaModel::FilterNonAllDay);
+    QVERIFY(updated->wait());
+    QCOMPARE(model->count(), 3);
+    for (int i = 0; i < model->count(); ++i)
+        QVERIFY(model->get(i, CalendarAgendaModel::EventObjectRole).value<CalendarEvent*>()->allDay());
+
+    model->setFilterMode(CalendarAgendaModel::FilterAllDay);
+    QVERIFY(updated->wait());
+    QCOMPARE(model->count(), 3);
+    for (int i = 0; i < model->count(); ++i)
+        QVERIFY(!model->get(i, CalendarAgendaModel::EventObjectRole).value<CalendarEvent*>()->allDay());
+
+    // All events are in the default notebook, the earliest one is kept.
+    model->setFilterMode(CalendarAgendaModel::FilterMultipleEventsPerNotebook);
+    QVERIFY(updated->wait());
+    QCOMPARE(model->count(), 1);
+    CalendarEvent *event = model->get(0, CalendarAgendaModel::EventObjectRole).value<CalendarEvent*>();
+    QCOMPARE(event->description(), QString::fromLatin1("all day event 3"));
+
+    delete updated;
+    delete model;
+}
+
 #include "tst_calendaragendamodel.moc"
 QTEST_MAIN(tst_CalendarAgendaModel)
@@ -32,6 +32,8 @@
 #include "test_plugin.h"
 
 #include <QDebug>
+#include <QMutexLocker>
+#include <QThread>
 
 const QString NAME("TestInvitationPlugin");
 
@@ -51,6 +53,8 @@ bool TestInvitationPlugin::sendInvitation(const QString &accountId, const QStrin
     Q_UNUSED(invitation);
     Q_UNUSED(body);
 
+    recordThread();
+    QMutexLocker locker(&m_mutex);
     m_sentInvitation = invitation;
 
     return true;
@@ -63,6 +67,8 @@ bool TestInvitationPlugin::sendUpdate(const QString &accountId, const KCalendarC
     Q_UNUSED(invitation);
     Q_UNUSED(body);
 
+    recordThread();
+    QMutexLocker locker(&m_mutex);
     m_updatedInvitations << invitation;
 
     return true;
@@ -75,6 +81,7 @@ bool TestInvitationPlugin::sendResponse(const QString &accountId, const KCalenda
     Q_UNUSED(invitation);
     Q_UNUSED(body);
 
+    recordThread();
     return true;
 }
 
@@ -100,6 +107,7 @@ bool TestInvitationPlugin::multiCalendar() const
 
 QString TestInvitationPlugin::emailAddress(const mKCal::Notebook::Ptr &notebook)
 {
+    recordThread();
     return notebook->customProperty("TEST_EMAIL");
 }
 
@@ -161,10 +169,24 @@ ServiceInterface::ErrorCode TestInvitationPlugin::error() const
 
 KCalendarCore::Incidence::Ptr TestInvitationPlugin::sentInvitation() const
 {
+    QMutexLocker locker(&m_mutex);
     return m_sentInvitation;
 }
 
 KCalendarCore::Incidence::List TestInvitationPlugin::updatedInvitations() const
 {
+    QMutexLocker locker(&m_mutex);
     return m_updatedInvitations;
 }
+
+QStringList TestInvitationPlugin::callingThreads() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_callingThreads;
+}
+
+void TestInvitationPlugin::recordThread()
+{
+    QMutexLocker locker(&m_mutex);
+    m_callingThreads.append(QThread::currentThread()->objectName());
+}
@@ -35,6 +35,8 @@
 #include <invitationhandlerif.h>
 #include <servicehandlerif.h>
 #include <QtCore/QObject>
+#include <QtCore/QMutex>
+#include <QtCore/QStringList>
 
 #include "../test_plugin_interface.h"
 
@@ -51,6 +53,8 @@ public:
 
     KCalendarCore::Incidence::Ptr sentInvitation() const;
     KCalendarCore::Incidence::List updatedInvitations() const;
+    // Names of the threads the plugin was called from.
+    QStringList callingThreads() const;
 
     //! \reimp InvitationHandler
     bool sendInvitation(const QString &accountId, const QString &notebookId, const KCalendarCore::Incidence::Ptr &invitation,
@@ -90,6 +94,10 @@ public:
     //! \reimp_end
 
 private:
+    void recordThread();
+
+    mutable QMutex m_mutex;
+    QStringList m_callingThreads;
     KCalendarCore::Incidence::Ptr m_sentInvitation;
     KCalendarCore::Incidence::List m_updatedInvitations;
 };
@@ -60,6 +60,9 @@ private slots:
     void modSetters();
     void testSave();
     void testModify();
+    void testSaveCoalescing();
+    void testBatch();
+    void testExternalModification();
     void testTimeZone_data();
     void testTimeZone();
     void testRecurrenceException();
@@ -299,6 +302,191 @@ void tst_CalendarEvent::testModify()
     QVERIFY(modSpy.wait());
 }
 
+void tst_CalendarEvent::testSaveCoalescing()
+{
+    const QDateTime start(QDate(2022, 3, 16), QTime(9, 0), Qt::UTC);
+    CalendarEventModification *eventMod = calendarApi->createNewEvent();
+    QVERIFY(eventMod != 0);
+    eventMod->setDescription(QStringLiteral("Coalesced event"));
+    eventMod->setStartTime(start, Qt::UTC);
+    eventMod->setEndTime(start.addSecs(3600), Qt::UTC);
+
+    QString uid;
+    QVERIFY(saveEvent(eventMod, &uid));
+    QVERIFY(!uid.isEmpty());
+    m_savedEvents.insert(uid);
+    delete eventMod;
+
+    CalendarEventQuery query;
+    QSignalSpy eventSpy(&query, &CalendarEventQuery::eventChanged);
+    query.setInstanceId(uid);
+    QVERIFY(eventSpy.wait());
+    CalendarStoredEvent *event = qobject_cast<CalendarStoredEvent*>(query.event());
+    QVERIFY(event);
+
+    // Successive saves of the same event are written once, with the last changes.
+    QSignalSpy startSpy(event, &CalendarStoredEvent::startTimeChanged);
+    for (int i = 1; i <= 3; ++i) {
+        eventMod = calendarApi->createModification(event);
+        eventMod->setStartTime(start.addSecs(i * 900), Qt::UTC);
+        eventMod->save();
+        delete eventMod;
+    }
+    QVERIFY(startSpy.wait());
+    QTest::qWait(500);
+    QCOMPARE(startSpy.count(), 1);
+    QCOMPARE(event->startTime(), start.addSecs(3 * 900));
+
+    // A read within the idle time brings the change to the calendar,
+    // it is still saved afterwards.
+    eventMod = calendarApi->createModification(event);
+    eventMod->setStartTime(start, Qt::UTC);
+    eventMod->save();
+    delete eventMod;
+    CalendarManager::instance()->fetchEventDetails(uid);
+    QVERIFY(startSpy.wait());
+    QCOMPARE(event->startTime(), start);
+}
+
+void tst_CalendarEvent::testBatch()
+{
+    const QDate day(2022, 4, 12);
+    CalendarAgendaModel agendaModel;
+    QSignalSpy updated(&agendaModel, &CalendarAgendaModel::updated);
+    agendaModel.setStartDate(day);
+    agendaModel.setEndDate(day);
+    QVERIFY(updated.wait());
+    const int count = agendaModel.count();
+
+    QSignalSpy committed(calendarApi, &CalendarApi::batchCommitted);
+    // Another API instance only reports its own batches.
+    CalendarApi otherApi;
+    QSignalSpy otherCommitted(&otherApi, &CalendarApi::batchCommitted);
+    calendarApi->beginBatch();
+    for (int i = 0; i < 3; ++i) {
+        CalendarEventModification *eventMod = calendarApi->createNewEvent();
+        eventMod->setDisplayLabel(QStringLiteral("Batched %1").arg(i));
+        eventMod->setStartTime(QDateTime(day, QTime(9 + i, 0)), Qt::LocalTime);
+        eventMod->setEndTime(QDateTime(day, QTime(10 + i, 0)), Qt::LocalTime);
+        eventMod->setCalendarUid(CalendarManager::instance()->defaultNotebook());
+        eventMod->save();
+        delete eventMod;
+    }
+    // Nothing reaches the storage before the commit.
+    QTest::qWait(200);
+    QCOMPARE(agendaModel.count(), count);
+    QVERIFY(committed.isEmpty());
+
+    calendarApi->commitBatch();
+    QVERIFY(committed.wait());
+    QCOMPARE(committed.count(), 1);
+    QVERIFY(committed.first().first().toBool());
+    QTRY_COMPARE(agendaModel.count(), count + 3);
+
+    QStringList uids;
+    for (int i = 0; i < agendaModel.count(); ++i) {
+        QVariant eventVariant = agendaModel.get(i, CalendarAgendaModel::EventObjectRole);
+        CalendarEvent *event = qvariant_cast<CalendarEvent*>(eventVariant);
+        if (event && event->displayLabel().startsWith(QStringLiteral("Batched ")))
+            uids << event->instanceId();
+    }
+    QCOMPARE(uids.count(), 3);
+
+    calendarApi->beginBatch();
+    for (const QString &uid : uids)
+        calendarApi->removeAll(uid);
+    calendarApi->commitBatch();
+    QVERIFY(committed.wait());
+    QCOMPARE(committed.count(), 2);
+    QTRY_COMPARE(agendaModel.count(), count);
+    QVERIFY(otherCommitted.isEmpty());
+
+    // Nested in the batch of the other instance, saved with it.
+    otherApi.beginBatch();
+    calendarApi->beginBatch();
+    calendarApi->commitBatch();
+    otherApi.commitBatch();
+    QVERIFY(otherCommitted.wait());
+    QCOMPARE(otherCommitted.count(), 1);
+    QTRY_COMPARE(committed.count(), 3);
+
+    // Batches left open by a destroyed instance do not hold the others.
+    CalendarApi *leftOpen = new CalendarApi;
+    leftOpen->beginBatch();
+    leftOpen->beginBatch();
+    calendarApi->beginBatch();
+    delete leftOpen;
+    calendarApi->commitBatch();
+    QVERIFY(committed.wait());
+    QCOMPARE(committed.count(), 4);
+}
+
+void tst_CalendarEvent::testExternalModification()
+{
+    const QDateTime start(QDate(2022, 5, 3), QTime(9, 0), Qt::UTC);
+    QString modifiedUid;
+    QString removedUid;
+    for (QString *uid : {&modifiedUid, &removedUid}) {
+        CalendarEventModification *eventMod = calendarApi->createNewEvent();
+        QVERIFY(eventMod != 0);
+        eventMod->setDisplayLabel(QStringLiteral("Unsaved change"));
+        eventMod->setStartTime(start, Qt::UTC);
+        eventMod->setEndTime(start.addSecs(3600), Qt::UTC);
+        QVERIFY(saveEvent(eventMod, uid));
+        m_savedEvents.insert(*uid);
+        delete eventMod;
+    }
+
+    CalendarEventQuery query;
+    QSignalSpy eventSpy(&query, &CalendarEventQuery::eventChanged);
+    query.setInstanceId(modifiedUid);
+    QVERIFY(eventSpy.wait());
+    CalendarStoredEvent *event = qobject_cast<CalendarStoredEvent*>(query.event());
+    QVERIFY(event);
+
+    // The batch keeps the changes in memory until the commit.
+    QSignalSpy committed(calendarApi, &CalendarApi::batchCommitted);
+    QSignalSpy modifiedSpy(CalendarManager::instance(), &CalendarManager::storageModified);
+    calendarApi->beginBatch();
+    CalendarEventModification *eventMod = calendarApi->createModification(event);
+    eventMod->setDisplayLabel(QStringLiteral("Changed before the external save"));
+    eventMod->save();
+    delete eventMod;
+    calendarApi->removeAll(removedUid);
+
+    // Another process writes to the storage meanwhile.
+    mKCal::ExtendedCalendar::Ptr cal(new mKCal::ExtendedCalendar(QTimeZone::systemTimeZone()));
+    mKCal::ExtendedStorage::Ptr storage = mKCal::ExtendedCalendar::defaultStorage(cal);
+    QVERIFY(storage->open());
+    KCalendarCore::Event::Ptr external(new KCalendarCore::Event);
+    external->setSummary(QStringLiteral("External event"));
+    external->setDtStart(start);
+    external->setDtEnd(start.addSecs(1800));
+    QVERIFY(cal->addEvent(external, CalendarManager::instance()->defaultNotebook()));
+    QVERIFY(storage->save());
+    QVERIFY(modifiedSpy.wait());
+
+    calendarApi->commitBatch();
+    QVERIFY(committed.wait());
+    QVERIFY(committed.first().first().toBool());
+
+    // Both changes reached the storage, next to the external one.
+    mKCal::ExtendedCalendar::Ptr saved(new mKCal::ExtendedCalendar(QTimeZone::systemTimeZone()));
+    mKCal::ExtendedStorage::Ptr savedStorage = mKCal::ExtendedCalendar::defaultStorage(saved);
+    QVERIFY(savedStorage->open());
+    QVERIFY(savedStorage->loadIncidenceInstance(modifiedUid));
+    savedStorage->loadIncidenceInstance(removedUid);
+    QVERIFY(savedStorage->loadIncidenceInstance(external->instanceIdentifier()));
+    QVERIFY(saved->instance(modifiedUid));
+    QCOMPARE(saved->instance(modifiedUid)->summary(), QStringLiteral("Changed before the external save"));
+    QVERIFY(!saved->instance(removedUid));
+    QVERIFY(saved->instance(external->instanceIdentifier()));
+    m_savedEvents.remove(removedUid);
+
+    cal->deleteIncidence(external);
+    QVERIFY(storage->save());
+}
+
 void tst_CalendarEvent::testTimeZone_data()
 {
     QTest::addColumn<Qt::TimeSpec>("spec");
@@ -804,9 +992,10 @@ void tst_CalendarEvent::testAttendees()
     m_savedEvents.insert(uid);
     delete eventMod;
 
-    // Check that the sendInvitation() service has received the right data.
+    // Check that the sendInvitation() service has received the right data,
+    // invitations are sent from their own thread.
+    QTRY_VERIFY(plugin->sentInvitation());
     const KCalendarCore::Incidence::Ptr sentInvitation = plugin->sentInvitation();
-    QVERIFY(sentInvitation);
     QCOMPARE(sentInvitation->uid(), uid);
     const KCalendarCore::Attendee::List sentAttendees = sentInvitation->attendees();
     QCOMPARE(sentAttendees.count(), 3);
@@ -879,8 +1068,8 @@ void tst_CalendarEvent::testAttendees()
     qDeleteAll(attendees);
 
     // Check that the updateInvitation() service as received the right data.
+    QTRY_COMPARE(plugin->updatedInvitations().count(), 2);
     const KCalendarCore::Incidence::List updatedInvitations = plugin->updatedInvitations();
-    QCOMPARE(updatedInvitations.count(), 2);
     // For the cancelled participants.
     const KCalendarCore::Incidence::Ptr cancelled = updatedInvitations[0];
     QVERIFY(cancelled);
@@ -903,11 +1092,26 @@ void tst_CalendarEvent::testAttendees()
     KCalendarCore::Attendee attFanny(fanny, fannyEmail, true, KCalendarCore::Attendee::NeedsAction, KCalendarCore::Attendee::OptParticipant);
     QVERIFY(updatedAttendees.contains(attEmily));
     QVERIFY(updatedAttendees.contains(attFanny));
+
+    // The response goes out from the sender thread, the status is saved after.
+    CalendarStoredEvent *event = qobject_cast<CalendarStoredEvent*>(query.event());
+    QVERIFY(event);
+    QSignalSpy responseSpy(event, &CalendarStoredEvent::responseSent);
+    QVERIFY(event->sendResponse(CalendarEvent::ResponseAccept));
+    QVERIFY(responseSpy.wait());
+    QVERIFY(responseSpy.first().first().toBool());
+    QTRY_COMPARE(event->ownerStatus(), CalendarEvent::ResponseAccept);
+
+    // The plugin is never called from two threads.
+    const QStringList threads = plugin->callingThreads();
+    QVERIFY(!threads.isEmpty());
+    for (const QString &thread : threads)
+        QCOMPARE(thread, QString::fromLatin1("calendarsender"));
 }
 
 void tst_CalendarEvent::cleanupTestCase()
 {
-    QSignalSpy modified(CalendarManager::instance(), &CalendarManager::storageModified);
+    QSignalSpy modified(CalendarManager::instance(), &CalendarManager::dataUpdated);
     foreach (const QString &uid, m_savedEvents)
         calendarApi->removeAll(uid);
     if (!m_savedEvents.isEmpty())
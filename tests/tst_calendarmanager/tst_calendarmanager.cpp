@@ -7,9 +7,15 @@
 
 // kcalendarcore
 #include <KCalendarCore/CalFormat>
+#include <KCalendarCore/MemoryCalendar>
 
 #include "calendarmanager.h"
 #include "calendaragendamodel.h"
+#include "calendareventmodification.h"
+#include "calendaroccurrenceindex.h"
+#include "calendarsender.h"
+#include "calendarutils.h"
+#include "calendarworker.h"
 #include <QSignalSpy>
 
 class tst_CalendarManager : public QObject
@@ -22,11 +28,40 @@ private slots:
     void test_isRangeLoaded();
     void test_addRanges_data();
     void test_addRanges();
+    void test_occurrenceKey();
+    void test_occurrenceIndex_data();
+    void test_occurrenceIndex();
+    void test_occurrenceIndexRemove();
+    void test_evictRanges();
+    void test_dataChangedScope();
+    void test_dataPatched();
+    void test_agendaDedup();
+    void test_eventDetails();
+    void test_modificationDetails();
+    void test_changedProperties();
+    void test_prefetchRanges_data();
+    void test_prefetchRanges();
+    void benchmark_agendaRangeQuery_data();
+    void benchmark_agendaRangeQuery();
+    void benchmark_dataLoaded_data();
+    void benchmark_dataLoaded();
+    void benchmark_agendaSort_data();
+    void benchmark_agendaSort();
+    void test_expandOccurrences();
+    void benchmark_expandOccurrences_data();
+    void benchmark_expandOccurrences();
+    void test_createEventStructs();
+    void benchmark_createEventStructs_data();
+    void benchmark_createEventStructs();
+    void test_nextOccurrenceSeek_data();
+    void test_nextOccurrenceSeek();
     void test_notebookApi();
+    void test_saveDeferral();
     void cleanupTestCase();
 
 private:
     mKCal::Notebook::Ptr createNotebook();
+    void loadPerElement(const CalendarData::LoadResult &result);
 
     CalendarManager *m_manager = nullptr;
     mKCal::ExtendedCalendar::Ptr m_calendar;
@@ -514,6 +549,710 @@ void tst_CalendarManager::test_addRanges()
     QVERIFY(result == combinedRanges);
 }
 
+static QList<CalendarData::EventOccurrence> createOccurrences(int count)
+{
+    // Spread occurrences over a year, lasting from a few minutes to
+    // a few days, with a fixed seed to get reproducible data.
+    quint32 seed = 1234;
+    auto random = [&seed](quint32 bound) {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 8) % bound;
+    };
+
+    QList<CalendarData::EventOccurrence> occurrences;
+    const QDateTime origin(QDate(2023, 1, 1), QTime(0, 0));
+    for (int i = 0; i < count; ++i) {
+        CalendarData::EventOccurrence eo;
+        eo.instanceId = QString::fromLatin1("event-%1").arg(i);
+        eo.eventAllDay = (i % 10 == 0);
+        eo.startTime = origin.addSecs(random(365 * 24 * 60) * 60);
+        eo.endTime = eo.startTime.addSecs(random(3 * 24 * 60) * 60);
+        occurrences << eo;
+    }
+    return occurrences;
+}
+
+static bool occurrenceOverlaps(const CalendarData::EventOccurrence &eo,
+                               const QDate &start, const QDate &end)
+{
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 14, 0))
+    const QDateTime startDt(start.startOfDay());
+    const QDateTime endDt(end.endOfDay());
+#else
+    const QDateTime startDt(start);
+    const QDateTime endDt(QDateTime(end).addDays(1).addMSecs(-1));
+#endif
+    // on all day events the end time is inclusive, otherwise not
+    return (eo.eventAllDay && eo.startTime.date() <= end && eo.endTime.date() >= start)
+        || (!eo.eventAllDay && eo.startTime < endDt && eo.endTime >= startDt);
+}
+
+void tst_CalendarManager::test_occurrenceKey()
+{
+    const int interned = CalendarData::OccurrenceKey::internedCount();
+    const QDateTime start(QDate(2023, 6, 5), QTime(10, 0));
+    {
+        const CalendarData::OccurrenceKey key(QStringLiteral("key-test"), start);
+        const CalendarData::OccurrenceKey same(QStringLiteral("key-test"), start);
+        const CalendarData::OccurrenceKey later(key, start.addDays(1).toMSecsSinceEpoch());
+        const CalendarData::OccurrenceKey other(QStringLiteral("key-test-other"), start);
+        QCOMPARE(CalendarData::OccurrenceKey::internedCount(), interned + 2);
+        QVERIFY(key == same);
+        QCOMPARE(qHash(key), qHash(same));
+        QVERIFY(key != later);
+        QVERIFY(key != other);
+        QCOMPARE(later.instanceId(), QStringLiteral("key-test"));
+        QCOMPARE(other.instanceId(), QStringLiteral("key-test-other"));
+        QCOMPARE(key.toString(), QString::fromLatin1("key-test-%1").arg(start.toMSecsSinceEpoch()));
+
+        CalendarData::OccurrenceKey assigned;
+        QVERIFY(assigned.instanceId().isEmpty());
+        assigned = other;
+        QVERIFY(assigned == other);
+    }
+    // Released with the last key.
+    QCOMPARE(CalendarData::OccurrenceKey::internedCount(), interned);
+}
+
+void tst_CalendarManager::test_occurrenceIndex_data()
+{
+    QTest::addColumn<QDate>("start");
+    QTest::addColumn<QDate>("end");
+
+    QTest::newRow("Before any occurrence") << QDate(2022, 6, 1) << QDate(2022, 6, 30);
+    QTest::newRow("First day") << QDate(2023, 1, 1) << QDate(2023, 1, 1);
+    QTest::newRow("One day") << QDate(2023, 3, 14) << QDate(2023, 3, 14);
+    QTest::newRow("One week") << QDate(2023, 6, 5) << QDate(2023, 6, 11);
+    QTest::newRow("One month") << QDate(2023, 9, 1) << QDate(2023, 9, 30);
+    QTest::newRow("Overlapping the end") << QDate(2023, 12, 20) << QDate(2024, 1, 10);
+    QTest::newRow("Whole year") << QDate(2023, 1, 1) << QDate(2023, 12, 31);
+}
+
+void tst_CalendarManager::test_occurrenceIndex()
+{
+    QFETCH(QDate, start);
+    QFETCH(QDate, end);
+
+    const QList<CalendarData::EventOccurrence> occurrences = createOccurrences(2000);
+    CalendarOccurrenceIndex index;
+    QSet<CalendarData::OccurrenceKey> expected;
+    for (const CalendarData::EventOccurrence &eo : occurrences) {
+        index.insert(eo.key(), eo);
+        if (occurrenceOverlaps(eo, start, end))
+            expected.insert(eo.key());
+    }
+    QCOMPARE(index.count(), occurrences.count());
+
+    const QVector<CalendarData::OccurrenceKey> result = index.occurrences(start, end);
+    QCOMPARE(result.count(), expected.count());
+    for (const CalendarData::OccurrenceKey &key : result)
+        QVERIFY2(expected.contains(key), qPrintable(key.toString()));
+}
+
+void tst_CalendarManager::test_occurrenceIndexRemove()
+{
+    const QDate start(2023, 3, 1);
+    const QDate end(2023, 4, 15);
+    const QList<CalendarData::EventOccurrence> occurrences = createOccurrences(2000);
+    CalendarOccurrenceIndex index;
+    for (int i = 0; i < 1500; ++i)
+        index.insert(occurrences[i].key(), occurrences[i]);
+    // Query once so that removal happens on both the built and the pending entries.
+    index.occurrences(start, end);
+    for (int i = 1500; i < occurrences.count(); ++i)
+        index.insert(occurrences[i].key(), occurrences[i]);
+
+    QSet<CalendarData::OccurrenceKey> removed;
+    QSet<CalendarData::OccurrenceKey> expected;
+    for (int i = 0; i < occurrences.count(); ++i) {
+        if (i % 3 == 0)
+            removed.insert(occurrences[i].key());
+        else if (occurrenceOverlaps(occurrences[i], start, end))
+            expected.insert(occurrences[i].key());
+    }
+    index.remove(removed);
+    QCOMPARE(index.count(), occurrences.count() - removed.count());
+
+    const QVector<CalendarData::OccurrenceKey> result = index.occurrences(start, end);
+    QCOMPARE(result.count(), expected.count());
+    for (const CalendarData::OccurrenceKey &key : result)
+        QVERIFY2(expected.contains(key), qPrintable(key.toString()));
+}
+
+void tst_CalendarManager::test_evictRanges()
+{
+    const QList<CalendarData::EventOccurrence> list = createOccurrences(2000);
+    QSharedPointer<CalendarData::LoadResult> result(new CalendarData::LoadResult);
+    for (const CalendarData::EventOccurrence &eo : list)
+        result->occurrences.insert(eo.key(), eo);
+    const CalendarData::Range year(QDate(2023, 1, 1), QDate(2023, 12, 31));
+    const CalendarData::Range june(QDate(2023, 6, 1), QDate(2023, 6, 30));
+    const CalendarData::Range may(QDate(2023, 5, 1), QDate(2023, 5, 31));
+
+    m_manager = new CalendarManager;
+    m_manager->setOccurrenceCacheLimit(500);
+    // June viewed in an earlier refresh, May in the current one.
+    ++m_manager->m_usageTick;
+    m_manager->touchRange(june);
+    ++m_manager->m_usageTick;
+    m_manager->touchRange(may);
+    result->ranges << year;
+    QSignalSpy changedSpy(m_manager, &CalendarManager::dataChanged);
+    m_manager->dataLoadedSlot(result);
+
+    // Views of the evicted months are told, before the loaded ranges.
+    QCOMPARE(changedSpy.count(), 2);
+    const QList<CalendarData::Range> evicted = changedSpy[0][0].value<QList<CalendarData::Range> >();
+    QVERIFY(!evicted.isEmpty());
+    QList<CalendarData::Range> missing;
+    for (const CalendarData::Range &range : evicted) {
+        QVERIFY(range.second < may.first || range.first > june.second);
+        QVERIFY(!m_manager->isRangeLoaded(range, &missing));
+    }
+
+    QVERIFY(m_manager->m_eventOccurrences.count() <= 500);
+    QCOMPARE(m_manager->m_occurrenceIndex.count(), m_manager->m_eventOccurrences.count());
+    QVERIFY(m_manager->isRangeLoaded(may, &missing));
+    QVERIFY(m_manager->isRangeLoaded(june, &missing));
+    QVERIFY(!m_manager->isRangeLoaded(year, &missing));
+
+    // Evicted occurrences are the ones outside the remaining ranges.
+    for (const CalendarData::EventOccurrence &eo : list) {
+        bool inLoadedRange = false;
+        for (const CalendarData::Range &range : m_manager->m_loadedRanges)
+            inLoadedRange |= occurrenceOverlaps(eo, range.first, range.second);
+        QCOMPARE(m_manager->m_eventOccurrences.contains(eo.key()), inLoadedRange);
+    }
+}
+
+void tst_CalendarManager::test_dataChangedScope()
+{
+    m_manager = CalendarManager::instance();
+    CalendarAgendaModel june;
+    june.setStartDate(QDate(2023, 6, 1));
+    june.setEndDate(QDate(2023, 6, 30));
+    CalendarAgendaModel december;
+    december.setStartDate(QDate(2023, 12, 1));
+    december.setEndDate(QDate(2023, 12, 31));
+    m_manager->m_agendaRefreshList.clear();
+
+    // A week of June, only that agenda is concerned.
+    QSharedPointer<CalendarData::LoadResult> result(new CalendarData::LoadResult);
+    result->ranges << CalendarData::Range(QDate(2023, 6, 5), QDate(2023, 6, 11));
+    m_manager->dataLoadedSlot(result);
+    QCOMPARE(m_manager->m_agendaRefreshList, QList<CalendarAgendaModel *>() << &june);
+    QCOMPARE(m_manager->dataRefreshCount(), 1);
+    QCOMPARE(m_manager->skippedDataRefreshCount(), 1);
+
+    // Search results, no agenda is concerned.
+    m_manager->m_agendaRefreshList.clear();
+    result.reset(new CalendarData::LoadResult);
+    result->instanceList << QStringLiteral("search-result");
+    m_manager->dataLoadedSlot(result);
+    QVERIFY(m_manager->m_agendaRefreshList.isEmpty());
+    QCOMPARE(m_manager->dataRefreshCount(), 1);
+    QCOMPARE(m_manager->skippedDataRefreshCount(), 3);
+
+    // Everything is concerned by a reset.
+    result.reset(new CalendarData::LoadResult);
+    result->reset = true;
+    m_manager->dataLoadedSlot(result);
+    QCOMPARE(m_manager->m_agendaRefreshList.count(), 2);
+    QCOMPARE(m_manager->dataRefreshCount(), 3);
+    QCOMPARE(m_manager->skippedDataRefreshCount(), 3);
+}
+
+void tst_CalendarManager::test_dataPatched()
+{
+    m_manager = new CalendarManager;
+    QSharedPointer<CalendarData::LoadResult> result(new CalendarData::LoadResult);
+    result->ranges << CalendarData::Range(QDate(2023, 6, 1), QDate(2023, 6, 30));
+    const QStringList series = QStringList() << QStringLiteral("patched") << QStringLiteral("kept");
+    for (int i = 0; i < series.count(); ++i) {
+        CalendarData::Event *event = new CalendarData::Event;
+        event->instanceId = series[i];
+        event->incidenceUid = series[i];
+        event->updateHashes();
+        result->events.insert(event->instanceId, CalendarData::EventPtr(event));
+        CalendarData::EventOccurrence eo;
+        eo.instanceId = series[i];
+        eo.eventAllDay = false;
+        eo.startTime = QDateTime(QDate(2023, 6, 5 + 10 * i), QTime(10, 0));
+        eo.endTime = eo.startTime.addSecs(3600);
+        result->occurrences.insert(eo.key(), eo);
+        result->dailyOccurrences[eo.startDate()] << eo.key();
+    }
+    m_manager->dataLoadedSlot(result);
+    CalendarStoredEvent *patched = m_manager->eventObject(QStringLiteral("patched"));
+    QSignalSpy removedSpy(patched, &CalendarStoredEvent::removed);
+    QSignalSpy changedSpy(m_manager, &CalendarManager::dataChanged);
+    QSignalSpy modifiedSpy(m_manager, &CalendarManager::storageModified);
+
+    // The series moves from the 5th to the 7th.
+    CalendarData::EventOccurrence moved;
+    moved.instanceId = QStringLiteral("patched");
+    moved.eventAllDay = false;
+    moved.startTime = QDateTime(QDate(2023, 6, 7), QTime(10, 0));
+    moved.endTime = moved.startTime.addSecs(3600);
+    QHash<CalendarData::OccurrenceKey, CalendarData::EventOccurrence> occurrences;
+    occurrences.insert(moved.key(), moved);
+    QHash<QDate, QVector<CalendarData::OccurrenceKey> > dailyOccurrences;
+    dailyOccurrences[moved.startDate()] << moved.key();
+    QHash<QString, CalendarData::EventPtr> events;
+    events.insert(moved.instanceId, result->events.value(moved.instanceId));
+    m_manager->dataPatchedSlot(QStringList() << QStringLiteral("patched"), events, occurrences, dailyOccurrences);
+
+    QVERIFY(modifiedSpy.isEmpty());
+    QCOMPARE(changedSpy.count(), 1);
+    QCOMPARE(changedSpy[0][0].value<QList<CalendarData::Range> >(),
+             QList<CalendarData::Range>() << CalendarData::Range(QDate(2023, 6, 5), QDate(2023, 6, 5))
+                                          << CalendarData::Range(QDate(2023, 6, 7), QDate(2023, 6, 7)));
+    QCOMPARE(changedSpy[0][1].toStringList(), QStringList() << QStringLiteral("patched"));
+    QCOMPARE(changedSpy[0][2].toBool(), false);
+    QVERIFY(removedSpy.isEmpty());
+    QVERIFY(m_manager->m_eventOccurrenceForDates.value(QDate(2023, 6, 5)).isEmpty());
+    QCOMPARE(m_manager->m_eventOccurrenceForDates.value(QDate(2023, 6, 7)),
+             QVector<CalendarData::OccurrenceKey>() << moved.key());
+    QCOMPARE(m_manager->m_eventOccurrenceForDates.value(QDate(2023, 6, 15)).count(), 1);
+    QCOMPARE(m_manager->m_occurrenceIndex.count(), 2);
+
+    // Deleted, the event object is told.
+    changedSpy.clear();
+    m_manager->dataPatchedSlot(QStringList() << QStringLiteral("patched"),
+                               QHash<QString, CalendarData::EventPtr>(),
+                               QHash<CalendarData::OccurrenceKey, CalendarData::EventOccurrence>(),
+                               QHash<QDate, QVector<CalendarData::OccurrenceKey> >());
+    QCOMPARE(removedSpy.count(), 1);
+    QCOMPARE(changedSpy.count(), 1);
+    QCOMPARE(changedSpy[0][0].value<QList<CalendarData::Range> >(),
+             QList<CalendarData::Range>() << CalendarData::Range(QDate(2023, 6, 7), QDate(2023, 6, 7)));
+    QCOMPARE(changedSpy[0][1].toStringList(), QStringList() << QStringLiteral("patched"));
+    QVERIFY(!m_manager->m_events.contains(QStringLiteral("patched")));
+    QVERIFY(m_manager->m_events.contains(QStringLiteral("kept")));
+    QCOMPARE(m_manager->m_occurrenceIndex.count(), 1);
+}
+
+void tst_CalendarManager::test_agendaDedup()
+{
+    m_manager = CalendarManager::instance();
+    const CalendarData::Range june(QDate(2023, 6, 1), QDate(2023, 6, 30));
+    m_manager->m_loadedRanges << june;
+    const QDateTime start(QDate(2023, 6, 5), QTime(10, 0));
+    for (int i = 0; i < 3; ++i) {
+        CalendarData::EventOccurrence eo;
+        eo.instanceId = QString::fromLatin1("event-%1").arg(i);
+        eo.eventAllDay = (i == 0);
+        eo.startTime = start.addDays(i);
+        eo.endTime = eo.startTime.addSecs(3600);
+        m_manager->m_eventOccurrences.insert(eo.key(), eo);
+        m_manager->m_occurrenceIndex.insert(eo.key(), eo);
+    }
+
+    CalendarAgendaModel widget;
+    widget.setStartDate(june.first);
+    widget.setEndDate(june.second);
+    CalendarAgendaModel header;
+    header.setStartDate(june.first);
+    header.setEndDate(june.second);
+    CalendarAgendaModel allDays;
+    allDays.setFilterMode(CalendarAgendaModel::FilterNonAllDay);
+    allDays.setStartDate(june.first);
+    allDays.setEndDate(june.second);
+    CalendarAgendaModel week;
+    week.setStartDate(QDate(2023, 6, 5));
+    week.setEndDate(QDate(2023, 6, 6));
+
+    m_manager->doAgendaAndQueryRefresh();
+    QCOMPARE(m_manager->agendaDedupCount(), 1);
+    QCOMPARE(widget.count(), 3);
+    QCOMPARE(header.count(), 3);
+    QCOMPARE(allDays.count(), 1);
+    QCOMPARE(week.count(), 2);
+
+    // Results are not kept from one refresh to the next.
+    m_manager->scheduleAgendaRefresh(&widget);
+    m_manager->doAgendaAndQueryRefresh();
+    QCOMPARE(m_manager->agendaDedupCount(), 1);
+}
+
+void tst_CalendarManager::test_eventDetails()
+{
+    m_manager = new CalendarManager;
+    CalendarData::Event slim;
+    slim.instanceId = QStringLiteral("slim-event");
+    slim.displayLabel = QStringLiteral("Meeting");
+    slim.detailsLoaded = false;
+    m_manager->m_events.insert(slim.instanceId, CalendarData::EventPtr(new CalendarData::Event(slim)));
+
+    CalendarStoredEvent *event = m_manager->eventObject(slim.instanceId);
+    QSignalSpy descriptionChanged(event, &CalendarEvent::descriptionChanged);
+    QSignalSpy locationChanged(event, &CalendarEvent::locationChanged);
+    // Reading the details requests them, once.
+    QVERIFY(event->description().isEmpty());
+    QVERIFY(event->location().isEmpty());
+    QCOMPARE(m_manager->m_eventDetailsRequests, QStringList() << slim.instanceId);
+
+    CalendarData::Event details = slim;
+    details.description = QStringLiteral("Long agenda");
+    details.location = QStringLiteral("Room 1");
+    details.detailsLoaded = true;
+    QHash<QString, CalendarData::Event> events;
+    events.insert(details.instanceId, details);
+    m_manager->eventDetailsLoadedSlot(QStringList() << details.instanceId, events);
+    QVERIFY(m_manager->m_eventDetailsPending.isEmpty());
+    const CalendarData::EventPtr record = m_manager->m_events.value(slim.instanceId);
+    QVERIFY(record->detailsLoaded);
+    QCOMPARE(event->description(), details.description);
+    QCOMPARE(event->location(), details.location);
+    QCOMPARE(descriptionChanged.count(), 1);
+    QCOMPARE(locationChanged.count(), 1);
+
+    // The object shares the record of the manager, passing it again changes nothing.
+    QSignalSpy displayLabelChanged(event, &CalendarEvent::displayLabelChanged);
+    event->setEvent(record);
+    CalendarData::Event renamed = *record;
+    renamed.displayLabel = QStringLiteral("Renamed");
+    event->setEvent(CalendarData::EventPtr(new CalendarData::Event(renamed)));
+    QCOMPARE(displayLabelChanged.count(), 1);
+    QCOMPARE(descriptionChanged.count(), 1);
+
+    // Reloaded without details, the previous ones are shown until fetched again.
+    event->setEvent(CalendarData::EventPtr(new CalendarData::Event(slim)));
+    QCOMPARE(event->description(), details.description);
+    QCOMPARE(descriptionChanged.count(), 1);
+    QVERIFY(m_manager->m_eventDetailsPending.contains(slim.instanceId));
+}
+
+void tst_CalendarManager::test_modificationDetails()
+{
+    m_manager = CalendarManager::instance();
+    CalendarData::Event slim;
+    slim.instanceId = QStringLiteral("slim-event");
+    slim.displayLabel = QStringLiteral("Meeting");
+    slim.detailsLoaded = false;
+    m_manager->m_events.insert(slim.instanceId, CalendarData::EventPtr(new CalendarData::Event(slim)));
+    CalendarStoredEvent *event = m_manager->eventObject(slim.instanceId);
+
+    // The details are fetched without waiting for them.
+    CalendarEventModification modification(event);
+    QCOMPARE(m_manager->m_eventDetailsRequests, QStringList() << slim.instanceId);
+    QSignalSpy descriptionChanged(&modification, &CalendarEventModification::descriptionChanged);
+    QSignalSpy locationChanged(&modification, &CalendarEventModification::locationChanged);
+    modification.setLocation(QStringLiteral("Room 2"));
+    QCOMPARE(locationChanged.count(), 1);
+
+    // Received, they do not replace what was set meanwhile.
+    CalendarData::Event details = slim;
+    details.description = QStringLiteral("Long agenda");
+    details.location = QStringLiteral("Room 1");
+    details.detailsLoaded = true;
+    QHash<QString, CalendarData::Event> events;
+    events.insert(details.instanceId, details);
+    m_manager->eventDetailsLoadedSlot(QStringList() << details.instanceId, events);
+    QCOMPARE(modification.description(), details.description);
+    QCOMPARE(modification.location(), QStringLiteral("Room 2"));
+    QCOMPARE(descriptionChanged.count(), 1);
+    QCOMPARE(locationChanged.count(), 1);
+}
+
+void tst_CalendarManager::test_changedProperties()
+{
+    CalendarData::Event event;
+    event.instanceId = QStringLiteral("event");
+    event.displayLabel = QStringLiteral("Meeting");
+    event.startTime = QDateTime(QDate(2026, 1, 1), QTime(10, 0));
+    event.endTime = event.startTime.addSecs(3600);
+    CalendarData::Event changed = event;
+    changed.displayLabel = QStringLiteral("Renamed");
+    changed.endTime = event.endTime.addSecs(1800);
+    const int expected = CalendarData::Event::DisplayLabelProperty | CalendarData::Event::EndTimeProperty;
+
+    // Records without hashes compare their properties.
+    QCOMPARE(int(changed.changedProperties(event)), expected);
+    QCOMPARE(int(event.changedProperties(event)), 0);
+
+    event.updateHashes();
+    changed.updateHashes();
+    QVERIFY(event.contentHash);
+    QCOMPARE(int(changed.changedProperties(event)), expected);
+
+    // Colliding hashes do not hide the change.
+    CalendarData::Event collided = changed;
+    collided.contentHash = event.contentHash;
+    for (int i = 0; i < CalendarData::Event::PropertyCount; ++i)
+        collided.propertyHashes[i] = event.propertyHashes[i];
+    QCOMPARE(int(collided.changedProperties(event)), expected);
+
+    // Properties not notified do not count.
+    CalendarData::Event moved = event;
+    moved.calendarUid = QStringLiteral("other-notebook");
+    moved.updateHashes();
+    QCOMPARE(moved.contentHash, event.contentHash);
+    QCOMPARE(int(moved.changedProperties(event)), 0);
+
+    // Details taken from another record keep the hashes up to date.
+    CalendarData::Event detailed = event;
+    detailed.description = QStringLiteral("Long agenda");
+    detailed.updateHashes();
+    CalendarData::Event merged = event;
+    merged.setDetails(detailed);
+    QCOMPARE(merged.contentHash, detailed.contentHash);
+    QCOMPARE(int(merged.changedProperties(event)), int(CalendarData::Event::DescriptionProperty));
+}
+
+void tst_CalendarManager::test_prefetchRanges_data()
+{
+    QTest::addColumn<QList<CalendarData::Range> >("loadedRanges");
+    QTest::addColumn<QList<CalendarData::Range> >("pendingRanges");
+    QTest::addColumn<int>("direction");
+    QTest::addColumn<QList<CalendarData::Range> >("prefetchRanges");
+
+    const CalendarData::Range march(QDate(2014, 3, 1), QDate(2014, 3, 31));
+    const CalendarData::Range before(QDate(2014, 1, 29), QDate(2014, 2, 28));
+    const CalendarData::Range after(QDate(2014, 4, 1), QDate(2014, 5, 1));
+    const QList<CalendarData::Range> loaded = QList<CalendarData::Range>() << march;
+    const QList<CalendarData::Range> none;
+
+    QTest::newRow("Moving forward") << loaded << none << 1
+                                    << (QList<CalendarData::Range>() << after);
+    QTest::newRow("Moving backward") << loaded << none << -1
+                                     << (QList<CalendarData::Range>() << before);
+    QTest::newRow("Unknown direction") << loaded << none << 0
+                                       << (QList<CalendarData::Range>() << before << after);
+    QTest::newRow("Next range partially loaded")
+        << (QList<CalendarData::Range>() << CalendarData::Range(march.first, QDate(2014, 4, 10)))
+        << none << 1
+        << (QList<CalendarData::Range>() << CalendarData::Range(QDate(2014, 4, 11), after.second));
+    QTest::newRow("Next range partially requested")
+        << loaded << (QList<CalendarData::Range>() << CalendarData::Range(after.first, QDate(2014, 4, 7)))
+        << 1
+        << (QList<CalendarData::Range>() << CalendarData::Range(QDate(2014, 4, 8), after.second));
+    QTest::newRow("Next range loaded")
+        << (QList<CalendarData::Range>() << CalendarData::Range(march.first, after.second))
+        << none << 1 << none;
+}
+
+void tst_CalendarManager::test_prefetchRanges()
+{
+    QFETCH(QList<CalendarData::Range>, loadedRanges);
+    QFETCH(QList<CalendarData::Range>, pendingRanges);
+    QFETCH(int, direction);
+    QFETCH(QList<CalendarData::Range>, prefetchRanges);
+
+    m_manager = new CalendarManager;
+    m_manager->m_loadedRanges = loadedRanges;
+    m_manager->m_prefetchPendingRanges = pendingRanges;
+    CalendarManager::AgendaView view;
+    view.range = CalendarData::Range(QDate(2014, 3, 1), QDate(2014, 3, 31));
+    view.direction = direction;
+    m_manager->m_agendaViews.insert(nullptr, view);
+
+    QCOMPARE(m_manager->prefetchRanges(), prefetchRanges);
+}
+
+void tst_CalendarManager::benchmark_agendaRangeQuery_data()
+{
+    QTest::addColumn<bool>("indexed");
+
+    QTest::newRow("Linear scan") << false;
+    QTest::newRow("Interval index") << true;
+}
+
+void tst_CalendarManager::benchmark_agendaRangeQuery()
+{
+    QFETCH(bool, indexed);
+
+    const QList<CalendarData::EventOccurrence> occurrences = createOccurrences(50000);
+    QHash<CalendarData::OccurrenceKey, CalendarData::EventOccurrence> loaded;
+    CalendarOccurrenceIndex index;
+    for (const CalendarData::EventOccurrence &eo : occurrences) {
+        loaded.insert(eo.key(), eo);
+        index.insert(eo.key(), eo);
+    }
+
+    // A week view, as in CalendarManager::updateAgendaModel().
+    const QDate start(2023, 6, 5);
+    const QDate end(2023, 6, 11);
+    const int expected = index.occurrences(start, end).count();
+    int count = 0;
+    QBENCHMARK {
+        if (indexed) {
+            count = index.occurrences(start, end).count();
+        } else {
+            count = 0;
+            for (const CalendarData::EventOccurrence &eo : loaded) {
+                if (occurrenceOverlaps(eo, start, end))
+                    ++count;
+            }
+        }
+    }
+    QVERIFY(count > 0);
+    QCOMPARE(count, expected);
+}
+
+// What dataLoadedSlot() did before adopting the load results, inserting
+// every element into the caches.
+void tst_CalendarManager::loadPerElement(const CalendarData::LoadResult &result)
+{
+    if (result.reset) {
+        m_manager->clearNextOccurrences();
+        m_manager->m_events.clear();
+        m_manager->m_eventOccurrences.clear();
+        m_manager->m_eventOccurrenceForDates.clear();
+        m_manager->m_occurrenceIndex.clear();
+        m_manager->m_loadedRanges.clear();
+        m_manager->m_loadedQueries.clear();
+    }
+
+    m_manager->m_loadedRanges = m_manager->addRanges(m_manager->m_loadedRanges, result.ranges);
+    m_manager->m_loadedQueries.append(result.instanceList);
+    for (QHash<QString, CalendarData::EventPtr>::ConstIterator it = result.events.constBegin();
+         it != result.events.constEnd(); ++it)
+        m_manager->m_events.insert(it.key(), it.value());
+    for (QHash<CalendarData::OccurrenceKey, CalendarData::EventOccurrence>::ConstIterator it = result.occurrences.constBegin();
+         it != result.occurrences.constEnd(); ++it) {
+        if (!m_manager->m_eventOccurrences.contains(it.key()))
+            m_manager->m_occurrenceIndex.insert(it.key(), it.value());
+        m_manager->m_eventOccurrences.insert(it.key(), it.value());
+    }
+    for (QHash<QDate, QVector<CalendarData::OccurrenceKey> >::ConstIterator it = result.dailyOccurrences.constBegin();
+         it != result.dailyOccurrences.constEnd(); ++it)
+        m_manager->m_eventOccurrenceForDates.insert(it.key(), it.value());
+    m_manager->m_loadPending = false;
+    m_manager->evictRanges();
+}
+
+void tst_CalendarManager::benchmark_dataLoaded_data()
+{
+    QTest::addColumn<bool>("reset");
+    QTest::addColumn<bool>("perElement");
+
+    QTest::newRow("Adopted on reset") << true << false;
+    // Baseline, as done before the load results were adopted.
+    QTest::newRow("Inserted per element on reset") << true << true;
+    QTest::newRow("Merged into the cache") << false << false;
+}
+
+void tst_CalendarManager::benchmark_dataLoaded()
+{
+    QFETCH(bool, reset);
+    QFETCH(bool, perElement);
+
+    const QList<CalendarData::EventOccurrence> occurrences = createOccurrences(50000);
+    QSharedPointer<CalendarData::LoadResult> result(new CalendarData::LoadResult);
+    result->ranges << CalendarData::Range(QDate(2023, 1, 1), QDate(2023, 12, 31));
+    result->reset = reset;
+    for (const CalendarData::EventOccurrence &eo : occurrences) {
+        result->occurrences.insert(eo.key(), eo);
+        for (QDate date = eo.startDate(); date <= eo.endDate(); date = date.addDays(1))
+            result->dailyOccurrences[date].append(eo.key());
+    }
+    // Something already cached from a previous load, also received again.
+    QSharedPointer<CalendarData::LoadResult> previous(new CalendarData::LoadResult);
+    previous->ranges << CalendarData::Range(QDate(2022, 12, 1), QDate(2022, 12, 31));
+    previous->reset = true;
+    previous->occurrences.insert(occurrences.first().key(), occurrences.first());
+
+    m_manager = new CalendarManager;
+    m_manager->setOccurrenceCacheLimit(occurrences.count() + 1);
+    if (perElement) {
+        QBENCHMARK {
+            m_manager->dataLoadedSlot(previous);
+            loadPerElement(*result);
+        }
+    } else {
+        QBENCHMARK {
+            m_manager->dataLoadedSlot(previous);
+            m_manager->dataLoadedSlot(result);
+        }
+    }
+    QCOMPARE(m_manager->m_eventOccurrences.count(), occurrences.count());
+    QCOMPARE(m_manager->m_occurrenceIndex.count(), m_manager->m_eventOccurrences.count());
+}
+
+void tst_CalendarManager::benchmark_agendaSort_data()
+{
+    QTest::addColumn<bool>("unchanged");
+
+    QTest::newRow("Sorted into an empty agenda") << false;
+    QTest::newRow("Diffed against the same rows") << true;
+}
+
+void tst_CalendarManager::benchmark_agendaSort()
+{
+    QFETCH(bool, unchanged);
+
+    // All day occurrences on the same day, ordered by their labels, with
+    // a few labels differing only by case to go through the tie-breaker.
+    const int count = 5000;
+    const QDateTime start(QDate(2023, 6, 5), QTime(0, 0));
+    QVector<CalendarData::EventOccurrence> occurrences;
+    m_manager = CalendarManager::instance();
+    for (int i = 0; i < count; ++i) {
+        CalendarData::Event *event = new CalendarData::Event;
+        event->instanceId = QString::fromLatin1("event-%1").arg(i);
+        event->displayLabel = (i % 2 ? QString::fromLatin1("Holiday %1") : QString::fromLatin1("HOLIDAY %1")).arg((count - i) % 500);
+        event->allDay = true;
+        event->startTime = start;
+        event->endTime = start;
+        event->updateHashes();
+        m_manager->m_events.insert(event->instanceId, CalendarData::EventPtr(event));
+
+        CalendarData::EventOccurrence eo;
+        eo.instanceId = event->instanceId;
+        eo.eventAllDay = true;
+        eo.startTime = start;
+        eo.endTime = start;
+        occurrences << eo;
+    }
+
+    CalendarAgendaModel *model = new CalendarAgendaModel;
+    if (unchanged)
+        model->doRefresh(occurrences);
+    QBENCHMARK {
+        model->doRefresh(occurrences);
+        if (!unchanged)
+            model->doRefresh(QVector<CalendarData::EventOccurrence>());
+    }
+    model->doRefresh(occurrences);
+    QCOMPARE(model->count(), count);
+    QCOMPARE(model->get(0, CalendarAgendaModel::EventObjectRole).value<CalendarEvent*>()->displayLabel(),
+             QString::fromLatin1("HOLIDAY 0"));
+    delete model;
+}
+
+void tst_CalendarManager::test_saveDeferral()
+{
+    CalendarWorker worker;
+    // Readable from other threads before init().
+    QCOMPARE(worker.outboundStatistics().backlog, 0);
+    worker.init();
+
+    // The service plugins are only used from their own thread.
+    QVERIFY(worker.m_sender);
+    QVERIFY(worker.m_sender->thread() != QThread::currentThread());
+    QCOMPARE(worker.m_sender->thread()->objectName(), QString::fromLatin1("calendarsender"));
+    QVERIFY(worker.m_senderThread.isRunning());
+
+    // A queued load goes before the save, a limited number of times.
+    worker.notifyLoadQueued();
+    for (int i = 1; i <= 10; ++i) {
+        worker.saveWhenIdle();
+        QCOMPARE(worker.m_saveDeferrals, i);
+        QVERIFY(worker.m_saveTimer->isActive());
+    }
+    worker.saveWhenIdle();
+    QCOMPARE(worker.m_saveDeferrals, 0);
+    QVERIFY(!worker.m_saveTimer->isActive());
+
+    // Not postponed anymore once the load has run.
+    worker.loadData(QList<CalendarData::Range>(), QStringList(), false);
+    worker.m_saveTimer->start();
+    worker.saveWhenIdle();
+    QCOMPARE(worker.m_saveDeferrals, 0);
+    QVERIFY(!worker.m_saveTimer->isActive());
+}
+
 mKCal::Notebook::Ptr tst_CalendarManager::createNotebook()
 {
     return mKCal::Notebook::Ptr(new mKCal::Notebook(KCalendarCore::CalFormat::createUniqueId(),
@@ -527,6 +1266,212 @@ mKCal::Notebook::Ptr tst_CalendarManager::createNotebook()
                                                     true)); // Visible.
 }
 
+static KCalendarCore::MemoryCalendar::Ptr createCalendar(int count)
+{
+    // A mix of single, daily and weekly events over a year,
+    // a few recurring ones with a moved occurrence.
+    KCalendarCore::MemoryCalendar::Ptr calendar(new KCalendarCore::MemoryCalendar(QTimeZone::systemTimeZone()));
+    const QDateTime origin(QDate(2023, 1, 1), QTime(8, 0));
+    for (int i = 0; i < count; ++i) {
+        KCalendarCore::Event::Ptr event(new KCalendarCore::Event);
+        event->setSummary(QString::fromLatin1("Event %1").arg(i));
+        event->setDtStart(origin.addDays(i % 365).addSecs((i % 10) * 3600));
+        event->setDtEnd(event->dtStart().addSecs(1800));
+        if (i % 4 == 1) {
+            event->recurrence()->setDaily(1);
+        } else if (i % 4 == 2) {
+            event->recurrence()->setWeekly(1);
+        }
+        calendar->addEvent(event);
+        if (i % 20 == 1) {
+            KCalendarCore::Incidence::Ptr exception
+                = KCalendarCore::Calendar::createException(event, event->dtStart().addDays(1));
+            exception->setDtStart(exception->dtStart().addSecs(7200));
+            exception.staticCast<KCalendarCore::Event>()->setDtEnd(exception->dtStart().addSecs(1800));
+            calendar->addIncidence(exception);
+        }
+    }
+    return calendar;
+}
+
+static QStringList expandedOccurrences(const KCalendarCore::MemoryCalendar::Ptr &calendar, bool parallel)
+{
+    KCalendarCore::Incidence::List series;
+    for (const KCalendarCore::Event::Ptr &event : calendar->rawEvents()) {
+        if (!event->hasRecurrenceId())
+            series.append(event);
+    }
+    const QList<CalendarUtils::Occurrence> occurrences
+        = CalendarUtils::expandOccurrences(*calendar, series, QDateTime(QDate(2023, 1, 1), QTime(0, 0)),
+                                           QDateTime(QDate(2023, 12, 31), QTime(23, 59, 59)), parallel);
+    QStringList ids;
+    for (const CalendarUtils::Occurrence &occurrence : occurrences)
+        ids << QString::fromLatin1("%1-%2").arg(occurrence.first->instanceIdentifier())
+                                           .arg(occurrence.second.toMSecsSinceEpoch());
+    return ids;
+}
+
+void tst_CalendarManager::test_expandOccurrences()
+{
+    const KCalendarCore::MemoryCalendar::Ptr calendar = createCalendar(400);
+    const QStringList serial = expandedOccurrences(calendar, false);
+    QVERIFY(serial.count() > 400);
+    // Exceptions replace their occurrence.
+    QSet<QString> unique;
+    for (const QString &id : serial)
+        unique.insert(id);
+    QCOMPARE(unique.count(), serial.count());
+    QCOMPARE(expandedOccurrences(calendar, true), serial);
+}
+
+void tst_CalendarManager::benchmark_expandOccurrences_data()
+{
+    QTest::addColumn<bool>("parallel");
+
+    QTest::newRow("Serial") << false;
+    QTest::newRow("Parallel") << true;
+}
+
+void tst_CalendarManager::benchmark_expandOccurrences()
+{
+    QFETCH(bool, parallel);
+
+    const KCalendarCore::MemoryCalendar::Ptr calendar = createCalendar(2000);
+    QStringList ids;
+    QBENCHMARK {
+        ids = expandedOccurrences(calendar, parallel);
+    }
+    QVERIFY(!ids.isEmpty());
+}
+
+static QList<CalendarWorker::EventSource> eventSources(const KCalendarCore::MemoryCalendar::Ptr &calendar)
+{
+    QList<CalendarWorker::EventSource> sources;
+    const KCalendarCore::Event::List events = calendar->rawEvents();
+    for (const KCalendarCore::Event::Ptr &event : events) {
+        CalendarWorker::EventSource source;
+        source.event = event;
+        source.notebook.uid = QStringLiteral("notebook");
+        source.notebook.exists = true;
+        source.notebook.ownerEmail = QStringLiteral("owner@example.org");
+        sources << source;
+    }
+    return sources;
+}
+
+void tst_CalendarManager::test_createEventStructs()
+{
+    const QList<CalendarWorker::EventSource> sources = eventSources(createCalendar(400));
+    const QList<CalendarData::EventPtr> events = CalendarWorker::createEventStructs(sources);
+    QCOMPARE(events.count(), sources.count());
+    // Converted in the order of the sources, as done serially.
+    for (int i = 0; i < sources.count(); ++i) {
+        const CalendarData::Event expected = CalendarWorker::createEventStruct(sources[i]);
+        const CalendarData::Event &event = *events[i];
+        QCOMPARE(event.instanceId, expected.instanceId);
+        QCOMPARE(event.incidenceUid, expected.incidenceUid);
+        QCOMPARE(event.recurrenceId, expected.recurrenceId);
+        QCOMPARE(event.calendarUid, sources[i].notebook.uid);
+        QCOMPARE(event.displayLabel, expected.displayLabel);
+        QCOMPARE(event.description, expected.description);
+        QCOMPARE(event.location, expected.location);
+        QCOMPARE(event.startTime, expected.startTime);
+        QCOMPARE(event.endTime, expected.endTime);
+        QCOMPARE(event.allDay, expected.allDay);
+        QCOMPARE(event.readOnly, expected.readOnly);
+        QCOMPARE(event.recur, expected.recur);
+        QCOMPARE(event.recurEndDate, expected.recurEndDate);
+        QCOMPARE(int(event.recurWeeklyDays), int(expected.recurWeeklyDays));
+        QCOMPARE(event.reminder, expected.reminder);
+        QCOMPARE(event.reminderDateTime, expected.reminderDateTime);
+        QCOMPARE(event.ownerStatus, expected.ownerStatus);
+        QCOMPARE(event.rsvp, expected.rsvp);
+        QCOMPARE(event.externalInvitation, expected.externalInvitation);
+        QCOMPARE(event.detailsLoaded, expected.detailsLoaded);
+        QCOMPARE(event.contentHash, expected.contentHash);
+        QCOMPARE(event.labelKey, expected.labelKey);
+    }
+}
+
+void tst_CalendarManager::benchmark_createEventStructs_data()
+{
+    QTest::addColumn<bool>("parallel");
+
+    QTest::newRow("serial") << false;
+    QTest::newRow("parallel") << true;
+}
+
+void tst_CalendarManager::benchmark_createEventStructs()
+{
+    QFETCH(bool, parallel);
+
+    const QList<CalendarWorker::EventSource> sources = eventSources(createCalendar(20000));
+    QList<CalendarData::EventPtr> events;
+    if (parallel) {
+        QBENCHMARK {
+            events = CalendarWorker::createEventStructs(sources);
+        }
+    } else {
+        // One conversion after the other, as done before.
+        QBENCHMARK {
+            events.clear();
+            for (const CalendarWorker::EventSource &source : sources)
+                events.append(CalendarData::EventPtr(new CalendarData::Event(CalendarWorker::createEventStruct(source))));
+        }
+    }
+    QCOMPARE(events.count(), sources.count());
+}
+
+void tst_CalendarManager::test_nextOccurrenceSeek_data()
+{
+    QTest::addColumn<QList<int> >("exceptionDays");
+    QTest::addColumn<int>("startDay");
+    QTest::addColumn<int>("expectedDay");
+
+    QList<int> run;
+    for (int day = 1; day <= 10; ++day)
+        run << day;
+
+    QTest::newRow("No exception") << QList<int>() << 3 << 3;
+    QTest::newRow("Start on an exception") << (QList<int>() << 3) << 3 << 4;
+    QTest::newRow("Run of exceptions") << (run + (QList<int>() << 20)) << 1 << 11;
+    QTest::newRow("Last exception") << (run + (QList<int>() << 20)) << 20 << 21;
+    QTest::newRow("Distant exceptions") << (QList<int>() << 3 << 4 << 28) << 3 << 5;
+    QTest::newRow("Distant exceptions backward") << (QList<int>() << 1 << 27 << 28 << 29) << 27 << 26;
+    // The series has 30 occurrences, fall back to the previous one.
+    QList<int> tail;
+    for (int day = 15; day < 30; ++day)
+        tail << day;
+    QTest::newRow("Exceptions up to the end") << (QList<int>() << 12 << 13 << 14 << tail) << 16 << 11;
+}
+
+void tst_CalendarManager::test_nextOccurrenceSeek()
+{
+    QFETCH(QList<int>, exceptionDays);
+    QFETCH(int, startDay);
+    QFETCH(int, expectedDay);
+
+    const QDateTime origin(QDate(2023, 1, 1), QTime(8, 0));
+    KCalendarCore::Event::Ptr event(new KCalendarCore::Event);
+    event->setDtStart(origin);
+    event->setDtEnd(origin.addSecs(3600));
+    event->recurrence()->setDaily(1);
+    event->recurrence()->setDuration(30);
+
+    KCalendarCore::Incidence::List exceptions;
+    for (int day : exceptionDays) {
+        KCalendarCore::Incidence::Ptr exception(event->clone());
+        exception->clearRecurrence();
+        exception->setRecurrenceId(origin.addDays(day));
+        exceptions << exception;
+    }
+
+    const CalendarData::EventOccurrence occurrence
+        = CalendarUtils::getNextOccurrence(event, origin.addDays(startDay), exceptions);
+    QCOMPARE(occurrence.startTime, origin.addDays(expectedDay));
+    QCOMPARE(occurrence.endTime, origin.addDays(expectedDay).addSecs(3600));
+}
+
 void tst_CalendarManager::test_notebookApi()
 {
     m_manager = new CalendarManager;
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include <QObject>
+#include <QSignalSpy>
+#include <QtTest>
+
+#include "calendaragendamodel.h"
+#include "calendarapi.h"
+#include "calendarevent.h"
+#include "calendareventmodification.h"
+#include "calendarmanager.h"
+#include "calendarmonthsummarymodel.h"
+
+#include "plugin.cpp"
+
+class tst_CalendarMonthSummaryModel : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void testSummary();
+    void testDayUpdate();
+
+private:
+    bool saveEvent(const QString &label, const QDate &date, bool allDay);
+};
+
+void tst_CalendarMonthSummaryModel::initTestCase()
+{
+    QSignalSpy ready(CalendarManager::instance(), &CalendarManager::notebooksChanged);
+    QVERIFY(ready.wait());
+
+    QVERIFY(saveEvent(QStringLiteral("work"), QDate(2023, 6, 5), false));
+    QVERIFY(saveEvent(QStringLiteral("holiday"), QDate(2023, 6, 5), true));
+    QVERIFY(saveEvent(QStringLiteral("dentist"), QDate(2023, 6, 7), false));
+}
+
+void tst_CalendarMonthSummaryModel::cleanupTestCase()
+{
+    CalendarAgendaModel agenda;
+    QSignalSpy updated(&agenda, &CalendarAgendaModel::updated);
+    agenda.setStartDate(QDate(2023, 6, 1));
+    agenda.setEndDate(QDate(2023, 8, 31));
+    QVERIFY(updated.wait());
+
+    CalendarApi api;
+    for (int i = 0; i < agenda.count(); ++i) {
+        CalendarEvent *event = qvariant_cast<CalendarEvent*>(agenda.get(i, CalendarAgendaModel::EventObjectRole));
+        if (event)
+            api.removeAll(event->instanceId());
+    }
+    QTRY_COMPARE(agenda.count(), 0);
+}
+
+void tst_CalendarMonthSummaryModel::testSummary()
+{
+    CalendarMonthSummaryModel model;
+    QSignalSpy updated(&model, &CalendarMonthSummaryModel::updated);
+    model.setStartDate(QDate(2023, 6, 1));
+    model.setEndDate(QDate(2023, 6, 30));
+    QVERIFY(updated.wait());
+
+    QCOMPARE(model.count(), 30);
+    QCOMPARE(model.get(4, CalendarMonthSummaryModel::DateRole).toDate(), QDate(2023, 6, 5));
+    QCOMPARE(model.get(4, CalendarMonthSummaryModel::EventCountRole).toInt(), 2);
+    QCOMPARE(model.get(4, CalendarMonthSummaryModel::HasAllDayRole).toBool(), true);
+    QCOMPARE(model.get(6, CalendarMonthSummaryModel::EventCountRole).toInt(), 1);
+    QCOMPARE(model.get(6, CalendarMonthSummaryModel::HasAllDayRole).toBool(), false);
+    QCOMPARE(model.get(6, CalendarMonthSummaryModel::ColorsRole).toStringList(),
+             QStringList() << CalendarManager::instance()->getNotebookColor(CalendarManager::instance()->defaultNotebook()));
+    QCOMPARE(model.get(5, CalendarMonthSummaryModel::EventCountRole).toInt(), 0);
+    QVERIFY(model.get(5, CalendarMonthSummaryModel::ColorsRole).toStringList().isEmpty());
+
+    // Other days, the whole grid changes.
+    QSignalSpy reset(&model, &QAbstractItemModel::modelReset);
+    model.setEndDate(QDate(2023, 6, 10));
+    QVERIFY(updated.wait());
+    QCOMPARE(reset.count(), 1);
+    QCOMPARE(model.count(), 10);
+    QCOMPARE(model.get(4, CalendarMonthSummaryModel::EventCountRole).toInt(), 2);
+}
+
+void tst_CalendarMonthSummaryModel::testDayUpdate()
+{
+    CalendarMonthSummaryModel model;
+    QSignalSpy updated(&model, &CalendarMonthSummaryModel::updated);
+    model.setStartDate(QDate(2023, 6, 1));
+    model.setEndDate(QDate(2023, 6, 30));
+    QVERIFY(updated.wait());
+
+    // Only the day having changed is updated.
+    QSignalSpy reset(&model, &QAbstractItemModel::modelReset);
+    QSignalSpy changed(&model, &QAbstractItemModel::dataChanged);
+    QVERIFY(saveEvent(QStringLiteral("lunch"), QDate(2023, 6, 7), false));
+    QTRY_COMPARE(model.get(6, CalendarMonthSummaryModel::EventCountRole).toInt(), 2);
+    QCOMPARE(reset.count(), 0);
+    QCOMPARE(changed.count(), 1);
+    QCOMPARE(changed.first().at(0).toModelIndex().row(), 6);
+    QCOMPARE(changed.first().at(1).toModelIndex().row(), 6);
+    QCOMPARE(model.get(4, CalendarMonthSummaryModel::EventCountRole).toInt(), 2);
+
+    // Changes elsewhere leave the days alone.
+    QVERIFY(saveEvent(QStringLiteral("trip"), QDate(2023, 8, 2), false));
+    QCOMPARE(reset.count(), 0);
+    QCOMPARE(changed.count(), 1);
+}
+
+bool tst_CalendarMonthSummaryModel::saveEvent(const QString &label, const QDate &date, bool allDay)
+{
+    QSignalSpy modified(CalendarManager::instance(), &CalendarManager::dataUpdated);
+    CalendarEventModification eventMod;
+    eventMod.setDisplayLabel(label);
+    eventMod.setAllDay(allDay);
+    eventMod.setStartTime(QDateTime(date, QTime(allDay ? 0 : 10, 0)), Qt::LocalTime);
+    eventMod.setEndTime(QDateTime(date, QTime(allDay ? 0 : 11, 0)), Qt::LocalTime);
+    eventMod.setCalendarUid(CalendarManager::instance()->defaultNotebook());
+    eventMod.save();
+    return modified.wait();
+}
+
+#include "tst_calendarmonthsummarymodel.moc"
+QTEST_MAIN(tst_CalendarMonthSummaryModel)
@@ -0,0 +1,4 @@
+include(../common.pri)
+
+TARGET = tst_calendarmonthsummarymodel
+SOURCES += tst_calendarmonthsummarymodel.cpp
@@ -6,6 +6,7 @@
 #include "calendarapi.h"
 #include "calendarmanager.h"
 #include "calendarsearchmodel.h"
+#include "calendareventoccurrence.h"
 
 #include "plugin.cpp"
 
@@ -17,6 +18,7 @@ private slots:
     void initTestCase();
 
     void test_searchString();
+    void test_recurringResult();
 
 private:
     QQmlEngine *engine;
@@ -37,7 +39,7 @@ void tst_CalendarSearchModel::initTestCase()
         qputenv("MKCAL_PLUGIN_DIR", "plugins");
 
     QSignalSpy modified(CalendarManager::instance(),
-                        &CalendarManager::storageModified);
+                        &CalendarManager::dataUpdated);
     CalendarEventModification *event = calendarApi->createNewEvent();
     QVERIFY(event != 0);
     event->setStartTime(QDateTime(QDate(2023,5,22), QTime(15,31)), Qt::LocalTime);
@@ -62,6 +64,33 @@ void tst_CalendarSearchModel::test_searchString()
     QCOMPARE(model->count(), 1);
 }
 
+void tst_CalendarSearchModel::test_recurringResult()
+{
+    QSignalSpy modified(CalendarManager::instance(),
+                        &CalendarManager::dataUpdated);
+    CalendarEventModification *event = calendarApi->createNewEvent();
+    QVERIFY(event != 0);
+    event->setStartTime(QDateTime(QDate(2023,5,22), QTime(10,0)), Qt::LocalTime);
+    event->setEndTime(QDateTime(QDate(2023,5,22), QTime(11,0)), Qt::LocalTime);
+    event->setRecur(CalendarEvent::RecurDaily);
+    event->setDisplayLabel(QString::fromLatin1("Daily qwerty meeting"));
+    event->save();
+    QVERIFY(modified.wait());
+
+    // The next occurrence of recurring results is fetched asynchronously.
+    CalendarSearchModel *model = new CalendarSearchModel(this);
+    model->setStartTime(QDateTime(QDate(2023,6,1), QTime(12,0)));
+    QSignalSpy identifiersSet(model, &CalendarSearchModel::identifiersChanged);
+    model->setSearchString(QString::fromLatin1("qwerty"));
+    QVERIFY(identifiersSet.wait());
+    QCOMPARE(model->identifiers().length(), 1);
+    QTRY_COMPARE(model->count(), 1);
+    QVERIFY(!model->loading());
+    CalendarEventOccurrence *occurrence = qobject_cast<CalendarEventOccurrence *>
+        (model->data(model->index(0, 0), CalendarEventListModel::OccurrenceObjectRole).value<QObject *>());
+    QVERIFY(occurrence);
+    QCOMPARE(occurrence->startTime(), QDateTime(QDate(2023,6,2), QTime(10,0)));
+}
 
 #include "tst_calendarsearchmodel.moc"
 QTEST_MAIN(tst_CalendarSearchModel)
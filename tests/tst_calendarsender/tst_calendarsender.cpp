@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include <QObject>
+#include <QtTest>
+
+// mKCal
+#include <notebook.h>
+
+// kcalendarcore
+#include <KCalendarCore/CalFormat>
+#include <KCalendarCore/Event>
+
+#include "calendarsender.h"
+
+// Records the messages instead of going through the service plugins.
+class TestSender : public CalendarSender
+{
+public:
+    QStringList delivered; // notebook uid of each sent message
+    int failures = 0; // next deliveries to fail
+
+protected:
+    bool deliver(const mKCal::Notebook::Ptr &notebook,
+                 const KCalendarCore::Incidence::Ptr &incidence,
+                 Message message) override
+    {
+        Q_UNUSED(incidence);
+        Q_UNUSED(message);
+        if (failures > 0) {
+            --failures;
+            return false;
+        }
+        delivered << notebook->uid();
+        return true;
+    }
+};
+
+class tst_CalendarSender : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testBatches();
+    void testRetries();
+    void testFlush();
+
+private:
+    mKCal::Notebook::Ptr createNotebook();
+    // Stands for the retry delay being over.
+    void retry(CalendarSender *sender);
+};
+
+void tst_CalendarSender::testBatches()
+{
+    TestSender sender;
+    const mKCal::Notebook::Ptr work = createNotebook();
+    const mKCal::Notebook::Ptr home = createNotebook();
+    const KCalendarCore::Incidence::Ptr event(new KCalendarCore::Event);
+
+    // Messages of a notebook are sent together, in order of first appearance.
+    // The next notebook waits for the next event loop turn.
+    sender.enqueue(work, event, CalendarSender::Invitation);
+    sender.enqueue(home, event, CalendarSender::Invitation);
+    sender.enqueue(work, event, CalendarSender::Update);
+    QCOMPARE(sender.statistics().backlog, 3);
+    sender.sendQueued();
+    QCOMPARE(sender.delivered, QStringList() << work->uid() << work->uid());
+    QCOMPARE(sender.statistics().backlog, 1);
+    QTRY_COMPARE(sender.delivered, QStringList() << work->uid() << work->uid() << home->uid());
+
+    const CalendarData::OutboundStatistics statistics = sender.statistics();
+    QCOMPARE(statistics.backlog, 0);
+    QCOMPARE(statistics.sent, 3);
+    QCOMPARE(statistics.retried, 0);
+    QCOMPARE(statistics.failed, 0);
+    QVERIFY(statistics.lastLatency >= 0);
+    QVERIFY(statistics.maxLatency >= statistics.lastLatency);
+}
+
+void tst_CalendarSender::testRetries()
+{
+    TestSender sender;
+    const mKCal::Notebook::Ptr work = createNotebook();
+    const mKCal::Notebook::Ptr home = createNotebook();
+    const KCalendarCore::Incidence::Ptr event(new KCalendarCore::Event);
+
+    sender.failures = 1;
+    sender.enqueue(work, event, CalendarSender::Invitation);
+    sender.sendQueued();
+    QVERIFY(sender.delivered.isEmpty());
+    QCOMPARE(sender.statistics().retried, 1);
+    QCOMPARE(sender.statistics().backlog, 1);
+
+    // Messages queued meanwhile do not bring the failed ones forward.
+    sender.enqueue(home, event, CalendarSender::Invitation);
+    sender.sendQueued();
+    QCOMPARE(sender.delivered, QStringList() << home->uid());
+    QCOMPARE(sender.statistics().backlog, 1);
+    retry(&sender);
+    QCOMPARE(sender.delivered, QStringList() << home->uid() << work->uid());
+    QCOMPARE(sender.statistics().backlog, 0);
+
+    // Given up after the last attempt.
+    sender.delivered.clear();
+    sender.failures = 3;
+    sender.enqueue(work, event, CalendarSender::Update);
+    sender.sendQueued();
+    retry(&sender);
+    retry(&sender);
+    QVERIFY(sender.delivered.isEmpty());
+    QCOMPARE(sender.statistics().failed, 1);
+    QCOMPARE(sender.statistics().backlog, 0);
+}
+
+void tst_CalendarSender::testFlush()
+{
+    TestSender sender;
+    const mKCal::Notebook::Ptr work = createNotebook();
+    const mKCal::Notebook::Ptr home = createNotebook();
+    const KCalendarCore::Incidence::Ptr event(new KCalendarCore::Event);
+
+    // Everything is sent on shutdown, failed messages are tried once more.
+    sender.failures = 1;
+    sender.enqueue(work, event, CalendarSender::Update);
+    sender.sendQueued();
+    QCOMPARE(sender.statistics().backlog, 1);
+    sender.enqueue(home, event, CalendarSender::Update);
+    sender.flush();
+    QCOMPARE(sender.delivered, QStringList() << work->uid() << home->uid());
+    QCOMPARE(sender.statistics().backlog, 0);
+
+    sender.failures = 1;
+    sender.enqueue(work, event, CalendarSender::Update);
+    sender.flush();
+    QCOMPARE(sender.statistics().failed, 1);
+    QCOMPARE(sender.statistics().backlog, 0);
+}
+
+mKCal::Notebook::Ptr tst_CalendarSender::createNotebook()
+{
+    return mKCal::Notebook::Ptr(new mKCal::Notebook(KCalendarCore::CalFormat::createUniqueId(),
+                                                    "",
+                                                    QLatin1String(""),
+                                                    "#110000",
+                                                    false, // Not shared.
+                                                    true, // Is master.
+                                                    false, // Not synced to Ovi.
+                                                    false, // Writable.
+                                                    true)); // Visible.
+}
+
+void tst_CalendarSender::retry(CalendarSender *sender)
+{
+    sender->retryQueued();
+}
+
+#include "tst_calendarsender.moc"
+QTEST_MAIN(tst_CalendarSender)
@@ -0,0 +1,4 @@
+include(../common.pri)
+
+TARGET = tst_calendarsender
+SOURCES += tst_calendarsender.cpp